@@ -0,0 +1,331 @@
+#include "bench.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <thread>
+#include "alloc_tracker.hpp"
+#include "simd.hpp"
+#include "span_fill.hpp"
+
+namespace bench {
+
+namespace {
+
+struct Benchmark {
+    std::string name;
+    BenchFunc func;
+    int64_t arg;
+};
+
+struct Result {
+    std::string name;
+    std::string aggregate;  // empty for a single run
+    uint64_t iterations;
+    double ns_per_op;
+    double allocs_per_op;
+    double items_per_second;
+};
+
+struct Options {
+    const char* filter;
+    const char* json_path;
+    double min_time;
+    uint64_t iterations;  // 0 to decide by min_time
+    int repetitions;
+    bool list;
+};
+
+const uint64_t MAX_ITERATIONS = 1000000000;
+
+std::vector<Benchmark>& Registry()
+{
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+void PrintUsage()
+{
+    fprintf(stderr,
+        "Usage: rubiks_bench [options]\n"
+        "\n"
+        "Options:\n"
+        "  -f, --filter TEXT     run benchmarks whose names contain TEXT\n"
+        "      --min-time SEC    minimum time of each run (default: 0.5)\n"
+        "      --iterations N    run a fixed number of iterations instead of --min-time\n"
+        "      --repetitions N   run each benchmark N times and add the median (default: 1)\n"
+        "      --json FILE       write results to FILE as JSON (\"-\" for stdout)\n"
+        "      --list            list benchmarks and exit\n"
+        "  -h, --help            show this message\n");
+}
+
+bool ParseOptions(int argc, char** argv, Options* options)
+{
+    options->filter = nullptr;
+    options->json_path = nullptr;
+    options->min_time = 0.5;
+    options->iterations = 0;
+    options->repetitions = 1;
+    options->list = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+            return false;
+        if (strcmp(arg, "--list") == 0) {
+            options->list = true;
+            continue;
+        }
+
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (value == nullptr) {
+            fprintf(stderr, "Error: %s needs a value.\n", arg);
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "-f") == 0 || strcmp(arg, "--filter") == 0) {
+            options->filter = value;
+        } else if (strcmp(arg, "--min-time") == 0) {
+            options->min_time = atof(value);
+        } else if (strcmp(arg, "--iterations") == 0) {
+            options->iterations = uint64_t(strtoull(value, nullptr, 10));
+        } else if (strcmp(arg, "--repetitions") == 0) {
+            options->repetitions = std::max(1, atoi(value));
+        } else if (strcmp(arg, "--json") == 0) {
+            options->json_path = value;
+        } else {
+            fprintf(stderr, "Error: unknown option '%s'.\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+Result RunOnce(const Benchmark& benchmark, const Options& options)
+{
+    // Grow the iteration count until a run takes min_time
+    uint64_t iterations = options.iterations > 0 ? options.iterations : 1;
+    while (true) {
+        State state(benchmark.arg, iterations);
+        benchmark.func(state);
+        double seconds = state.Seconds();
+        bool done = options.iterations > 0 || seconds >= options.min_time ||
+                    iterations >= MAX_ITERATIONS;
+        if (done) {
+            Result result;
+            result.name = benchmark.name;
+            result.iterations = iterations;
+            result.ns_per_op = seconds * 1e9 / double(iterations);
+            result.allocs_per_op = double(state.Allocations()) / double(iterations);
+            result.items_per_second = seconds > 0 ? double(state.ItemsProcessed()) / seconds : 0;
+            return result;
+        }
+
+        // Aim a bit past min_time, but don't grow more than 10 times at once
+        double multiplier = options.min_time * 1.4 / std::max(seconds, 1e-9);
+        multiplier = std::min(10.0, std::max(2.0, multiplier));
+        iterations = std::min(MAX_ITERATIONS, uint64_t(double(iterations) * multiplier));
+    }
+}
+
+double Median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    return (n % 2) ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) * 0.5;
+}
+
+Result MedianResult(const std::vector<Result>& runs)
+{
+    std::vector<double> ns, allocs, items;
+    for (const Result& r : runs) {
+        ns.push_back(r.ns_per_op);
+        allocs.push_back(r.allocs_per_op);
+        items.push_back(r.items_per_second);
+    }
+    Result result = runs[0];
+    result.aggregate = "median";
+    result.ns_per_op = Median(ns);
+    result.allocs_per_op = Median(allocs);
+    result.items_per_second = Median(items);
+    return result;
+}
+
+void PrintResult(FILE* fp, const Result& r)
+{
+    std::string name = r.aggregate.empty() ? r.name : r.name + "_" + r.aggregate;
+    fprintf(fp, "%-36s %14.1f %12.2f %14.4g %12llu\n", name.c_str(), r.ns_per_op,
+            r.allocs_per_op, r.items_per_second, (unsigned long long)r.iterations);
+    fflush(fp);
+}
+
+std::string CompilerName()
+{
+#if defined(__clang__)
+    return "clang " __clang_version__;
+#elif defined(__GNUC__)
+    return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+    char buf[32];
+    snprintf(buf, sizeof(buf), "msvc %d", _MSC_VER);
+    return buf;
+#else
+    return "unknown";
+#endif
+}
+
+std::string JsonString(const std::string& text)
+{
+    std::string json = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            json += '\\';
+        if (c >= 0 && c < 0x20)
+            continue;
+        json += c;
+    }
+    return json + "\"";
+}
+
+bool WriteJson(const char* path, const std::vector<Result>& results)
+{
+    FILE* fp = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!fp)
+        return false;
+
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+#ifdef NDEBUG
+    const char* build_type = "release";
+#else
+    const char* build_type = "debug";
+#endif
+
+    fprintf(fp, "{\n  \"context\": {\n");
+    fprintf(fp, "    \"date\": \"%s\",\n", date);
+    fprintf(fp, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(fp, "    \"library_build_type\": \"%s\",\n", build_type);
+    fprintf(fp, "    \"compiler\": %s,\n", JsonString(CompilerName()).c_str());
+    fprintf(fp, "    \"simd\": \"%s\",\n", simd::KernelName());
+    fprintf(fp, "    \"span_kernel\": \"%s\"\n", simd::SpanKernelName(simd::BestSpanKernel()));
+    fprintf(fp, "  },\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        std::string name = r.aggregate.empty() ? r.name : r.name + "_" + r.aggregate;
+        fprintf(fp, "    {\n");
+        fprintf(fp, "      \"name\": %s,\n", JsonString(name).c_str());
+        fprintf(fp, "      \"run_name\": %s,\n", JsonString(r.name).c_str());
+        fprintf(fp, "      \"run_type\": \"%s\",\n", r.aggregate.empty() ? "iteration" : "aggregate");
+        if (!r.aggregate.empty())
+            fprintf(fp, "      \"aggregate_name\": \"%s\",\n", r.aggregate.c_str());
+        fprintf(fp, "      \"iterations\": %llu,\n", (unsigned long long)r.iterations);
+        fprintf(fp, "      \"real_time\": %.3f,\n", r.ns_per_op);
+        fprintf(fp, "      \"time_unit\": \"ns\",\n");
+        fprintf(fp, "      \"allocs_per_iter\": %.3f,\n", r.allocs_per_op);
+        fprintf(fp, "      \"items_per_second\": %.6g\n", r.items_per_second);
+        fprintf(fp, "    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    if (fp != stdout)
+        fclose(fp);
+    return true;
+}
+
+}  // namespace
+
+State::State(int64_t arg, uint64_t max_iterations)
+    : m_arg(arg), m_max_iterations(max_iterations), m_iterations(0), m_items(0),
+      m_seconds(0), m_allocs(0), m_alloc_start(0), m_timing(false) {}
+
+void State::StartTimer()
+{
+    m_timing = true;
+    m_alloc_start = rubiks::AllocationCount();
+    m_start = Clock::now();
+}
+
+void State::StopTimer()
+{
+    Clock::time_point end = Clock::now();
+    m_allocs += rubiks::AllocationCount() - m_alloc_start;
+    m_seconds += std::chrono::duration<double>(end - m_start).count();
+    m_timing = false;
+}
+
+void State::PauseTiming()
+{
+    if (m_timing)
+        StopTimer();
+}
+
+void State::ResumeTiming()
+{
+    if (!m_timing)
+        StartTimer();
+}
+
+int RegisterBenchmark(const char* name, BenchFunc func, const std::vector<int64_t>& args)
+{
+    if (args.empty()) {
+        Registry().push_back({ name, func, 0 });
+        return 0;
+    }
+    for (int64_t arg : args)
+        Registry().push_back({ std::string(name) + "/" + std::to_string(arg), func, arg });
+    return 0;
+}
+
+int RunBenchmarks(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, &options)) {
+        PrintUsage();
+        return 1;
+    }
+
+    std::vector<const Benchmark*> selected;
+    for (const Benchmark& b : Registry()) {
+        if (!options.filter || b.name.find(options.filter) != std::string::npos)
+            selected.push_back(&b);
+    }
+    if (options.list) {
+        for (const Benchmark* b : selected)
+            printf("%s\n", b->name.c_str());
+        return 0;
+    }
+
+    // Keep the table on stderr when JSON goes to stdout
+    bool json_stdout = options.json_path && strcmp(options.json_path, "-") == 0;
+    FILE* table = json_stdout ? stderr : stdout;
+    fprintf(table, "%-36s %14s %12s %14s %12s\n",
+            "Benchmark", "ns/op", "allocs/op", "items/s", "iterations");
+
+    std::vector<Result> results;
+    for (const Benchmark* b : selected) {
+        std::vector<Result> runs;
+        for (int i = 0; i < options.repetitions; i++) {
+            runs.push_back(RunOnce(*b, options));
+            PrintResult(table, runs.back());
+        }
+        results.insert(results.end(), runs.begin(), runs.end());
+        if (options.repetitions > 1) {
+            results.push_back(MedianResult(runs));
+            PrintResult(table, results.back());
+        }
+    }
+
+    if (options.json_path && !WriteJson(options.json_path, results)) {
+        fprintf(stderr, "Error: failed to write '%s'.\n", options.json_path);
+        return 1;
+    }
+    return 0;
+}
+
+}  // namespace bench
+
+int main(int argc, char** argv)
+{
+    return bench::RunBenchmarks(argc, argv);
+}
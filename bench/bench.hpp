@@ -0,0 +1,119 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Small microbenchmark harness in the style of Google Benchmark.
+// Benchmarks are registered with BENCHMARK() and run by bench::RunBenchmarks().
+//
+//  static void BM_Something(bench::State& state) {
+//      Prepare(state.Arg());
+//      while (state.KeepRunning())
+//          DoSomething();
+//      state.SetItemsProcessed(state.Iterations() * items_per_call);
+//  }
+//  BENCHMARK_ARGS(BM_Something, 2, 3, 4);  // one run for each argument
+namespace bench {
+
+class State {
+ private:
+    typedef std::chrono::steady_clock Clock;
+
+    int64_t m_arg;
+    uint64_t m_max_iterations;
+    uint64_t m_iterations;
+    uint64_t m_items;
+    Clock::time_point m_start;
+    double m_seconds;  // time measured by finished timers
+    uint64_t m_allocs;  // allocations measured by finished timers
+    uint64_t m_alloc_start;
+    bool m_timing;
+
+    void StartTimer();
+    void StopTimer();
+
+ public:
+    State(int64_t arg, uint64_t max_iterations);
+
+    // Argument of the benchmark. It's 0 for benchmarks without arguments.
+    int64_t Arg() const
+    {
+        return m_arg;
+    }
+
+    // It returns true until the benchmark has run enough iterations.
+    // The timer starts at the first call and stops at the last call.
+    bool KeepRunning()
+    {
+        if (m_iterations < m_max_iterations) {
+            if (m_iterations++ == 0)
+                StartTimer();
+            return true;
+        }
+        if (m_timing)
+            StopTimer();
+        return false;
+    }
+
+    uint64_t Iterations() const
+    {
+        return m_max_iterations;
+    }
+
+    // Exclude setup in the loop from the measurement.
+    void PauseTiming();
+    void ResumeTiming();
+
+    // Items processed by all iterations, for the throughput
+    void SetItemsProcessed(uint64_t items)
+    {
+        m_items = items;
+    }
+
+    uint64_t ItemsProcessed() const
+    {
+        return m_items;
+    }
+
+    double Seconds() const
+    {
+        return m_seconds;
+    }
+
+    uint64_t Allocations() const
+    {
+        return m_allocs;
+    }
+};
+
+typedef void (*BenchFunc)(State& state);
+
+// Register a benchmark for each argument. It returns a dummy value for static initializers.
+int RegisterBenchmark(const char* name, BenchFunc func, const std::vector<int64_t>& args);
+
+// Run benchmarks with command line options. Use --help for details.
+int RunBenchmarks(int argc, char** argv);
+
+// Keep the compiler from removing computations of a value.
+template <typename T>
+inline void DoNotOptimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+}  // namespace bench
+
+#define BENCH_CONCAT_IMPL(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_IMPL(a, b)
+#define BENCHMARK(func) \
+    static int BENCH_CONCAT(bench_registered_, __LINE__) = \
+        bench::RegisterBenchmark(#func, func, {})
+#define BENCHMARK_ARGS(func, ...) \
+    static int BENCH_CONCAT(bench_registered_, __LINE__) = \
+        bench::RegisterBenchmark(#func, func, { __VA_ARGS__ })
@@ -0,0 +1,278 @@
+// Microbenchmarks of projection, sorting and moves.
+// Cube sizes are the arguments of the benchmarks.
+#include <random>
+#include <string>
+#include <vector>
+#include "bench.hpp"
+#include "move_program.hpp"  // MoveProgram, CompileMoves
+#include "rubiks.hpp"  // RubiksCube, Cube
+#include "scrambler.hpp"  // Scrambler, GenerateScrambles
+#include "table_cache.hpp"  // TableCachePath
+
+using rubiks::RubiksCube;
+
+namespace {
+
+#define CUBE_SIZES 2, 3, 4, 8, 16, 32
+
+// Fixed seed, so every run sees the same moves
+const unsigned BENCH_SEED = 12345;
+
+void BM_QuadModelProject(bench::State& state)
+{
+    rubiks::Cube cube;
+    cube.Initialize();
+    cube.scale = 10.0;
+    cube.rotation = geometry::RotationX(0.3) * geometry::RotationY(0.5);
+    Matrix3D global_rotation = geometry::RotationX(rubiks::RUBIKS_PI / 6.0);
+    Vec3D global_translation(180.0, 180.0, 300.0);
+    FrameContext frame;
+    frame.Resize(8, 6);
+    while (state.KeepRunning()) {
+        frame.Clear();
+        cube.Project(global_rotation, global_translation, 0, 0, frame);
+        bench::DoNotOptimize(frame.visible_face_count);
+    }
+    state.SetItemsProcessed(state.Iterations() * cube.vertices.Size());  // vertices
+}
+BENCHMARK(BM_QuadModelProject);
+
+// A whole frame: projection and z sorting.
+// The projection cache is cleared every frame, as the view moves.
+void BM_RubiksProject(bench::State& state)
+{
+    RubiksCube rubiks;
+    rubiks.Initialize(int(state.Arg()));
+    while (state.KeepRunning()) {
+        rubiks.cache.InvalidateAll();
+        const FrameContext& frame = rubiks.Project();
+        bench::DoNotOptimize(frame.visible_face_count);
+    }
+    state.SetItemsProcessed(state.Iterations() * rubiks.cubes.size());  // cubes
+}
+BENCHMARK_ARGS(BM_RubiksProject, CUBE_SIZES);
+
+// A frame of a layer turn. Only the turning layer is projected again.
+void BM_RubiksProjectLayerTurn(bench::State& state)
+{
+    RubiksCube rubiks;
+    rubiks.Initialize(int(state.Arg()));
+    int layer = rubiks.cube_num / 2;
+    double theta = 0;
+    while (state.KeepRunning()) {
+        theta += rubiks::RUBIKS_PI / 60;
+        rubiks.RotateFace(0, layer, 0, rubiks::AXIS_Y, theta);
+        const FrameContext& frame = rubiks.Project();
+        bench::DoNotOptimize(frame.visible_face_count);
+    }
+    state.SetItemsProcessed(state.Iterations() * rubiks.cubes.size());  // cubes
+}
+BENCHMARK_ARGS(BM_RubiksProjectLayerTurn, CUBE_SIZES);
+
+// A frame without changes, e.g. a timer tick while idle
+void BM_RubiksProjectIdle(bench::State& state)
+{
+    RubiksCube rubiks;
+    rubiks.Initialize(int(state.Arg()));
+    rubiks.Project();
+    while (state.KeepRunning()) {
+        const FrameContext& frame = rubiks.Project();
+        bench::DoNotOptimize(frame.visible_face_count);
+    }
+    state.SetItemsProcessed(state.Iterations() * rubiks.cubes.size());  // cubes
+}
+BENCHMARK_ARGS(BM_RubiksProjectIdle, CUBE_SIZES);
+
+// Sort visible faces in the order of projection
+void BM_Zsort(bench::State& state)
+{
+    RubiksCube rubiks;
+    rubiks.Initialize(int(state.Arg()));
+    rubiks.Project(false);
+    FrameContext& frame = rubiks.frame;
+    std::vector<Quad> unsorted(frame.visible_faces.begin(),
+                               frame.visible_faces.begin() + frame.visible_face_count);
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        std::copy(unsorted.begin(), unsorted.end(), frame.visible_faces.begin());
+        state.ResumeTiming();
+        geometry::Zsort(frame);
+        bench::DoNotOptimize(frame.visible_faces[0]);
+    }
+    state.SetItemsProcessed(state.Iterations() * unsorted.size());  // faces
+}
+BENCHMARK_ARGS(BM_Zsort, CUBE_SIZES);
+
+// Sort faces of animation frames. Each frame drags the camera a little,
+// or turns the middle layer by 3 degrees.
+void BenchSortFrames(bench::State& state, bool coherent, bool layer_turn)
+{
+    RubiksCube rubiks;
+    rubiks.Initialize(int(state.Arg()));
+    int layer = rubiks.cube_num / 2;
+    double theta = 0;
+    rubiks.Project();  // the first order for the coherent sort
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        if (layer_turn) {
+            theta += rubiks::RUBIKS_PI / 60;
+            rubiks.RotateFace(0, layer, 0, rubiks::AXIS_Y, theta);
+        } else {
+            rubiks.GlobalRotate(Vec3D(2.0, 1.0, 0.0));
+        }
+        rubiks.Project(false);
+        state.ResumeTiming();
+        if (coherent)
+            rubiks.sorter.Sort(rubiks.frame);
+        else
+            geometry::Zsort(rubiks.frame);
+        bench::DoNotOptimize(rubiks.frame.visible_faces[0]);
+    }
+    state.SetItemsProcessed(state.Iterations() * rubiks.frame.visible_face_count);  // faces
+}
+
+void BM_ZsortCameraMove(bench::State& state)
+{
+    BenchSortFrames(state, false, false);
+}
+BENCHMARK_ARGS(BM_ZsortCameraMove, CUBE_SIZES);
+
+void BM_DepthSorterCameraMove(bench::State& state)
+{
+    BenchSortFrames(state, true, false);
+}
+BENCHMARK_ARGS(BM_DepthSorterCameraMove, CUBE_SIZES);
+
+void BM_ZsortLayerTurn(bench::State& state)
+{
+    BenchSortFrames(state, false, true);
+}
+BENCHMARK_ARGS(BM_ZsortLayerTurn, CUBE_SIZES);
+
+void BM_DepthSorterLayerTurn(bench::State& state)
+{
+    BenchSortFrames(state, true, true);
+}
+BENCHMARK_ARGS(BM_DepthSorterLayerTurn, CUBE_SIZES);
+
+// A quarter turn of a random layer on the sticker array
+void BM_RotateColors(bench::State& state)
+{
+    RubiksCube rubiks;
+    rubiks.Initialize(int(state.Arg()));
+    std::mt19937 rng(BENCH_SEED);
+    int n = rubiks.cube_num;
+    while (state.KeepRunning()) {
+        int axis = int(rng() % 3) + 1;
+        int layer = int(rng() % n);
+        rubiks.RotateColors(axis == rubiks::AXIS_X ? layer : 0,
+                            axis == rubiks::AXIS_Y ? layer : 0,
+                            axis == rubiks::AXIS_Z ? layer : 0,
+                            axis, rubiks::DEGREE_90);
+        bench::DoNotOptimize(rubiks.facelets[0]);
+    }
+    state.SetItemsProcessed(state.Iterations());  // moves
+}
+BENCHMARK_ARGS(BM_RotateColors, CUBE_SIZES);
+
+// One animation step of a layer turn
+void BM_RotateFace(bench::State& state)
+{
+    RubiksCube rubiks;
+    rubiks.Initialize(int(state.Arg()));
+    std::mt19937 rng(BENCH_SEED);
+    int n = rubiks.cube_num;
+    double theta = 0;
+    while (state.KeepRunning()) {
+        int axis = int(rng() % 3) + 1;
+        int layer = int(rng() % n);
+        theta += 0.1;
+        rubiks.RotateFace(axis == rubiks::AXIS_X ? layer : 0,
+                          axis == rubiks::AXIS_Y ? layer : 0,
+                          axis == rubiks::AXIS_Z ? layer : 0,
+                          axis, theta);
+        bench::DoNotOptimize(rubiks.cubes[0].translation);
+    }
+    state.SetItemsProcessed(state.Iterations() * n * n);  // cubes in a layer
+}
+BENCHMARK_ARGS(BM_RotateFace, CUBE_SIZES);
+
+// Random face turns of a long move log, e.g. "R U2 F' ..."
+std::string RandomMoveLog(size_t move_num)
+{
+    static const char* SUFFIXES[3] = { "", "2", "'" };
+    std::mt19937 rng(BENCH_SEED);
+    std::string text;
+    for (size_t i = 0; i < move_num; i++) {
+        text += rubiks::NOTATION_FACE_NAMES[rng() % 6];
+        text += SUFFIXES[rng() % 3];
+        text += ' ';
+    }
+    return text;
+}
+
+const size_t MOVE_LOG_SIZE = 4096;
+
+// Parse and merge a move log. Items are moves.
+void BM_CompileMoves(bench::State& state)
+{
+    std::string text = RandomMoveLog(MOVE_LOG_SIZE);
+    rubiks::MoveProgram program;
+    while (state.KeepRunning()) {
+        rubiks::CompileMoves(text, int(state.Arg()), &program);
+        bench::DoNotOptimize(program.Code().size());
+    }
+    state.SetItemsProcessed(state.Iterations() * MOVE_LOG_SIZE);
+}
+BENCHMARK_ARGS(BM_CompileMoves, CUBE_SIZES);
+
+// Replay a compiled move log. Items are layer rotations after merging.
+void BM_ApplyMoveProgram(bench::State& state)
+{
+    RubiksCube rubiks;
+    rubiks.Initialize(int(state.Arg()));
+    rubiks::MoveProgram program;
+    rubiks::CompileMoves(RandomMoveLog(MOVE_LOG_SIZE), rubiks.cube_num, &program);
+    while (state.KeepRunning()) {
+        program.Apply(&rubiks);
+        bench::DoNotOptimize(rubiks.facelets[0]);
+    }
+    state.SetItemsProcessed(state.Iterations() * program.Code().size());
+}
+BENCHMARK_ARGS(BM_ApplyMoveProgram, CUBE_SIZES);
+
+// Redundancy-free random move scrambles. Items are scrambles.
+void BM_RandomMoveScramble(bench::State& state)
+{
+    rubiks::Scrambler scrambler(int(state.Arg()));
+    scrambler.Seed(BENCH_SEED);
+    std::vector<rubiks::NotationMove> scramble;
+    while (state.KeepRunning()) {
+        scrambler.RandomMoves(&scramble);
+        bench::DoNotOptimize(scramble[0]);
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
+BENCHMARK_ARGS(BM_RandomMoveScramble, CUBE_SIZES);
+
+// Batches of 256 random state scrambles of 3x3 cubes with Arg() threads.
+// Items are scrambles.
+void BM_RandomStateScrambles(bench::State& state)
+{
+    static rubiks::TwoPhaseTables tables;
+    if (!tables.built)
+        tables.Build(rubiks::TableCachePath("two_phase.tbl"));
+    rubiks::Scrambler scrambler(3, rubiks::SCRAMBLE_RANDOM_STATE, &tables);
+    rubiks::ThreadPool pool(int(state.Arg()));
+    std::vector<std::vector<rubiks::NotationMove>> scrambles;
+    const size_t batch_size = 256;
+    uint32_t seed = BENCH_SEED;
+    while (state.KeepRunning()) {
+        rubiks::GenerateScrambles(&pool, scrambler, seed++, batch_size, &scrambles);
+        bench::DoNotOptimize(scrambles[0]);
+    }
+    state.SetItemsProcessed(state.Iterations() * batch_size);
+}
+BENCHMARK_ARGS(BM_RandomStateScrambles, 1, 2, 4, 8);
+
+}  // namespace
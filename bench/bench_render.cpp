@@ -0,0 +1,145 @@
+// Microbenchmarks of offscreen rendering.
+// Cube sizes are the arguments of the render benchmarks unless noted.
+#include <random>
+#include <vector>
+#include "bench.hpp"
+#include "draw_batcher.hpp"  // DrawBatcher
+#include "rubiks.hpp"  // RubiksCube
+#include "software_renderer.hpp"  // SoftwareRenderer
+#include "span_fill.hpp"  // GetFillSpan
+
+using rubiks::RubiksCube;
+
+namespace {
+
+const int WIDTH_4K = 3840;
+const int HEIGHT_4K = 2160;
+const int WIDTH_1080P = 1920;
+const int HEIGHT_1080P = 1080;
+
+// Fill spans of Arg() pixels. Items are pixels.
+void BenchFillSpan(bench::State& state, simd::SpanKernel kernel)
+{
+    simd::FillSpanFunc fill_span = simd::GetFillSpan(kernel);
+    size_t n = size_t(state.Arg());
+    // One pixel off the alignment, as spans of faces usually are
+    std::vector<uint32_t> row(n + 1);
+    uint32_t pixel = 0;
+    while (state.KeepRunning()) {
+        fill_span(row.data() + 1, n, pixel++);
+        bench::DoNotOptimize(row[1]);
+    }
+    state.SetItemsProcessed(state.Iterations() * n);
+}
+
+void BM_FillSpan(bench::State& state)
+{
+    BenchFillSpan(state, simd::BestSpanKernel());
+}
+BENCHMARK_ARGS(BM_FillSpan, 16, 64, 256, 1920);
+
+void BM_FillSpanScalar(bench::State& state)
+{
+    BenchFillSpan(state, simd::SPAN_KERNEL_SCALAR);
+}
+BENCHMARK_ARGS(BM_FillSpanScalar, 16, 64, 256, 1920);
+
+// Rasterize a projected frame. Items are frames, so items/s is fps.
+void BenchRender(bench::State& state, int width, int height, simd::SpanKernel kernel,
+                 int cube_num, int thread_num = 1)
+{
+    RubiksCube rubiks;
+    rubiks.Initialize(cube_num);
+    const FrameContext& frame = rubiks.Project();
+    rubiks::SoftwareRenderer renderer(width, height, thread_num);
+    renderer.SetSpanKernel(kernel);
+    renderer.DrawFrame(frame, rubiks::COLOR_GRAY);  // grow buffers before timing
+    while (state.KeepRunning()) {
+        renderer.DrawFrame(frame, rubiks::COLOR_GRAY);
+        bench::DoNotOptimize(renderer.GetFramebuffer().pixels[0]);
+    }
+    state.SetItemsProcessed(state.Iterations());  // frames
+}
+
+void BM_SoftwareRender1080p(bench::State& state)
+{
+    BenchRender(state, WIDTH_1080P, HEIGHT_1080P, simd::BestSpanKernel(), int(state.Arg()));
+}
+BENCHMARK_ARGS(BM_SoftwareRender1080p, 3, 8, 32);
+
+void BM_SoftwareRender1080pScalar(bench::State& state)
+{
+    BenchRender(state, WIDTH_1080P, HEIGHT_1080P, simd::SPAN_KERNEL_SCALAR, int(state.Arg()));
+}
+BENCHMARK_ARGS(BM_SoftwareRender1080pScalar, 3, 8, 32);
+
+void BM_SoftwareRender4K(bench::State& state)
+{
+    BenchRender(state, WIDTH_4K, HEIGHT_4K, simd::BestSpanKernel(), int(state.Arg()));
+}
+BENCHMARK_ARGS(BM_SoftwareRender4K, 2, 3, 8, 32);
+
+// 8x8x8 cube at 4K with Arg() threads
+void BM_SoftwareRender4KThreads(bench::State& state)
+{
+    BenchRender(state, WIDTH_4K, HEIGHT_4K, simd::BestSpanKernel(), 8, int(state.Arg()));
+}
+BENCHMARK_ARGS(BM_SoftwareRender4KThreads, 1, 2, 4, 8);
+
+// Whole frames with projection: sorted faces with the painter's algorithm,
+// or unsorted faces with the depth test.
+// The projection cache is cleared every frame, as the view moves.
+void BenchProjectAndRender(bench::State& state, bool depth_test)
+{
+    RubiksCube rubiks;
+    rubiks.Initialize(int(state.Arg()));
+    rubiks::SoftwareRenderer renderer(WIDTH_1080P, HEIGHT_1080P);
+    renderer.SetDepthTest(depth_test);
+    renderer.DrawFrame(rubiks.Project(!depth_test), rubiks::COLOR_GRAY);
+    while (state.KeepRunning()) {
+        rubiks.cache.InvalidateAll();
+        renderer.DrawFrame(rubiks.Project(!depth_test), rubiks::COLOR_GRAY);
+        bench::DoNotOptimize(renderer.GetFramebuffer().pixels[0]);
+    }
+    state.SetItemsProcessed(state.Iterations());  // frames
+}
+
+void BM_FrameSorted1080p(bench::State& state)
+{
+    BenchProjectAndRender(state, false);
+}
+BENCHMARK_ARGS(BM_FrameSorted1080p, 3, 8, 16, 32, 64);
+
+void BM_FrameDepthTest1080p(bench::State& state)
+{
+    BenchProjectAndRender(state, true);
+}
+BENCHMARK_ARGS(BM_FrameDepthTest1080p, 3, 8, 16, 32, 64);
+
+// Group faces of a scrambled cube into batches for the libui backend. Items are faces.
+void BM_DrawBatch(bench::State& state)
+{
+    RubiksCube rubiks;
+    int cube_num = int(state.Arg());
+    rubiks.Initialize(cube_num);
+    std::mt19937 rng(12345);  // same scramble for every run
+    for (int i = 0; i < cube_num * 20; i++) {
+        int axis = int(rng() % 3) + 1;
+        int layer = int(rng() % cube_num);
+        rubiks.RotateColors(axis == rubiks::AXIS_X ? layer : 0,
+                            axis == rubiks::AXIS_Y ? layer : 0,
+                            axis == rubiks::AXIS_Z ? layer : 0,
+                            axis, rubiks::DEGREE_90);
+    }
+    const FrameContext& frame = rubiks.Project();
+    rubiks::DrawBatcher batcher;
+    batcher.Batch(frame);  // grow buffers before timing
+    while (state.KeepRunning()) {
+        const std::vector<rubiks::DrawBatch>& batches = batcher.Batch(frame);
+        bench::DoNotOptimize(batches.size());
+    }
+    state.SetItemsProcessed(state.Iterations() * frame.visible_face_count);  // faces
+}
+BENCHMARK_ARGS(BM_DrawBatch, 3, 8, 16, 32);
+
+}  // namespace
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Counting of heap allocations.
+// src/alloc_tracker.cpp replaces the global operator new and delete,
+// so it's linked into executables instead of the engine library.
+// rubiks_bench always has it. The app and rubiks_cli have it when
+// the "alloc_tracker" option of meson defines RUBIKS_ALLOC_TRACKER.
+namespace rubiks {
+
+// Number of heap allocations made by operator new so far
+uint64_t AllocationCount();
+
+// Allocations since construction or Restart()
+class AllocationCounter {
+ private:
+    uint64_t m_start;
+
+ public:
+    AllocationCounter() : m_start(AllocationCount()) {}
+
+    void Restart()
+    {
+        m_start = AllocationCount();
+    }
+
+    uint64_t Count() const
+    {
+        return AllocationCount() - m_start;
+    }
+};
+
+// Allocations of repeated operations, such as frames or moves,
+// checked against a budget per operation.
+class AllocationBudget {
+ private:
+    const char* m_name;
+    uint64_t m_budget;
+    size_t m_ops;
+    size_t m_over;  // operations over the budget
+    uint64_t m_total;
+    uint64_t m_max;
+
+ public:
+    AllocationBudget(const char* name, uint64_t budget) :
+        m_name(name), m_budget(budget), m_ops(0), m_over(0), m_total(0), m_max(0) {}
+
+    // Add allocations of an operation. It returns false when they are over the budget.
+    bool Add(uint64_t count);
+
+    size_t OverBudget() const
+    {
+        return m_over;
+    }
+
+    // e.g. "frame: 0.00 allocs/op, max 0, 0 of 120 over the budget of 0"
+    std::string Format() const;
+};
+
+}  // namespace rubiks
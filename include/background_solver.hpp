@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "cubie.hpp"
+
+namespace rubiks {
+
+// Runs a solver on another thread, so the libui main loop keeps drawing.
+// Call Poll() from a timer to know when it's done.
+class BackgroundSolver {
+ public:
+    typedef std::function<bool(const CubieCube& cube, std::vector<int>* solution)> SolveFunc;
+
+ private:
+    std::thread m_thread;
+    std::atomic<bool> m_finished;
+    bool m_running;
+    bool m_found;
+    CubieCube m_cube;
+    std::vector<int> m_solution;
+
+ public:
+    BackgroundSolver() : m_finished(false), m_running(false), m_found(false) {}
+
+    ~BackgroundSolver()
+    {
+        Wait();
+    }
+
+    bool IsRunning() const
+    {
+        return m_running;
+    }
+
+    // Start solving a cube. It returns false while another solve is running.
+    bool Start(const CubieCube& cube, const SolveFunc& solve)
+    {
+        if (m_running)
+            return false;
+        m_running = true;
+        m_finished = false;
+        m_found = false;
+        m_cube = cube;
+        m_solution.clear();
+        m_thread = std::thread([this, solve]() {
+            m_found = solve(m_cube, &m_solution);
+            m_finished.store(true, std::memory_order_release);
+        });
+        return true;
+    }
+
+    // It returns true once when the running solve has finished.
+    bool Poll()
+    {
+        if (!m_running || !m_finished.load(std::memory_order_acquire))
+            return false;
+        m_thread.join();
+        m_running = false;
+        return true;
+    }
+
+    // Block until the running solve finishes.
+    void Wait()
+    {
+        if (!m_running)
+            return;
+        m_thread.join();
+        m_running = false;
+    }
+
+    // Results of the last solve
+    bool Found() const
+    {
+        return m_found;
+    }
+
+    const CubieCube& Cube() const
+    {
+        return m_cube;
+    }
+
+    const std::vector<int>& Solution() const
+    {
+        return m_solution;
+    }
+};
+
+}  // namespace rubiks
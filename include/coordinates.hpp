@@ -0,0 +1,252 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "cubie.hpp"
+
+// Coordinates map parts of CubieCube to integers.
+// Solvers use them as indices of move tables and pruning tables.
+namespace rubiks {
+namespace coord {
+
+const int CORNER_PERM_NUM = 40320;  // 8!
+const int CORNER_ORI_NUM = 2187;  // 3^7
+const int EDGE_ORI_NUM = 2048;  // 2^11
+const int SLICE_NUM = 495;  // 12C4
+const int SLICE_PERM_NUM = 24;  // 4!
+const int SLICE_SORTED_NUM = 11880;  // 12! / 8!
+const int UD_EDGE_PERM_NUM = 40320;  // 8!
+
+inline int PopCount(uint32_t x)
+{
+    int count = 0;
+    for (; x; x &= x - 1)
+        count++;
+    return count;
+}
+
+// Rank k distinct values taken from [0, n) in mixed radix n, n - 1, ..., n - k + 1.
+inline uint32_t RankPartialPerm(const int* values, int k, int n)
+{
+    uint32_t rank = 0;
+    uint32_t used = 0;
+    for (int i = 0; i < k; i++) {
+        uint32_t lower = (1u << values[i]) - 1;
+        int smaller = values[i] - PopCount(used & lower);
+        rank = rank * uint32_t(n - i) + uint32_t(smaller);
+        used |= 1u << values[i];
+    }
+    return rank;
+}
+
+inline void UnrankPartialPerm(uint32_t rank, int k, int n, int* values)
+{
+    int digits[12];
+    for (int i = k - 1; i >= 0; i--) {
+        digits[i] = int(rank % uint32_t(n - i));
+        rank /= uint32_t(n - i);
+    }
+    uint32_t used = 0;
+    for (int i = 0; i < k; i++) {
+        // Find the digits[i]-th unused value
+        int v = 0;
+        for (int count = digits[i]; ; v++) {
+            if (used & (1u << v))
+                continue;
+            if (count == 0)
+                break;
+            count--;
+        }
+        values[i] = v;
+        used |= 1u << v;
+    }
+}
+
+// Corner permutation (0 to 8! - 1)
+inline int GetCornerPerm(const CubieCube& c)
+{
+    int perm[8];
+    for (int i = 0; i < 8; i++)
+        perm[i] = c.CornerPerm(i);
+    return int(RankPartialPerm(perm, 8, 8));
+}
+
+inline void SetCornerPerm(CubieCube* c, int index)
+{
+    int perm[8];
+    UnrankPartialPerm(uint32_t(index), 8, 8, perm);
+    for (int i = 0; i < 8; i++)
+        c->SetCorner(i, perm[i], c->CornerOri(i));
+}
+
+// Corner orientation (0 to 3^7 - 1). The last corner follows the others.
+inline int GetCornerOri(const CubieCube& c)
+{
+    int index = 0;
+    for (int i = 0; i < 7; i++)
+        index = index * 3 + c.CornerOri(i);
+    return index;
+}
+
+inline void SetCornerOri(CubieCube* c, int index)
+{
+    int sum = 0;
+    for (int i = 6; i >= 0; i--) {
+        int ori = index % 3;
+        index /= 3;
+        sum += ori;
+        c->SetCorner(i, c->CornerPerm(i), ori);
+    }
+    c->SetCorner(7, c->CornerPerm(7), (3 - sum % 3) % 3);
+}
+
+// Edge orientation (0 to 2^11 - 1). The last edge follows the others.
+inline int GetEdgeOri(const CubieCube& c)
+{
+    int index = 0;
+    for (int i = 0; i < 11; i++)
+        index = index * 2 + c.EdgeOri(i);
+    return index;
+}
+
+inline void SetEdgeOri(CubieCube* c, int index)
+{
+    int sum = 0;
+    for (int i = 10; i >= 0; i--) {
+        int ori = index & 1;
+        index >>= 1;
+        sum += ori;
+        c->SetEdge(i, c->EdgePerm(i), ori);
+    }
+    c->SetEdge(11, c->EdgePerm(11), sum & 1);
+}
+
+inline int Binomial(int n, int k)
+{
+    if (k < 0 || k > n)
+        return 0;
+    int result = 1;
+    for (int i = 0; i < k; i++)
+        result = result * (n - i) / (i + 1);
+    return result;
+}
+
+// Positions of the 4 middle layer edges (FR, FL, BL, BR), ignoring their order.
+// It's 0 when they are in the middle layer.
+inline int GetSlice(const CubieCube& c)
+{
+    int index = 0;
+    int k = 4;
+    for (int i = 11; i >= 0 && k > 0; i--) {
+        if (c.EdgePerm(i) >= FR) {
+            index += Binomial(i, k);
+            k--;
+        }
+    }
+    return SLICE_NUM - 1 - index;
+}
+
+// Set middle layer edges to the positions of a slice coordinate.
+// Other edges are placed in increasing order.
+inline void SetSlice(CubieCube* c, int index)
+{
+    index = SLICE_NUM - 1 - index;
+    int k = 4;
+    int slice_edge = FR;
+    int other_edge = UR;
+    bool is_slice[12];
+    for (int i = 11; i >= 0; i--) {
+        int b = Binomial(i, k);
+        is_slice[i] = k > 0 && index >= b;
+        if (is_slice[i]) {
+            index -= b;
+            k--;
+        }
+    }
+    for (int i = 0; i < 12; i++) {
+        if (is_slice[i])
+            c->SetEdge(i, slice_edge++, c->EdgeOri(i));
+        else
+            c->SetEdge(i, other_edge++, c->EdgeOri(i));
+    }
+}
+
+// Positions and order of the 4 middle layer edges (0 to 12! / 8! - 1)
+inline int GetSliceSorted(const CubieCube& c)
+{
+    int pos[4];
+    for (int i = 0; i < 12; i++) {
+        if (c.EdgePerm(i) >= FR)
+            pos[c.EdgePerm(i) - FR] = i;
+    }
+    return int(RankPartialPerm(pos, 4, 12));
+}
+
+// Other edges are placed in increasing order.
+inline void SetSliceSorted(CubieCube* c, int index)
+{
+    int pos[4];
+    UnrankPartialPerm(uint32_t(index), 4, 12, pos);
+    int perm[12];
+    std::fill(perm, perm + 12, -1);
+    for (int i = 0; i < 4; i++)
+        perm[pos[i]] = FR + i;
+    int other_edge = UR;
+    for (int i = 0; i < 12; i++)
+        c->SetEdge(i, perm[i] >= 0 ? perm[i] : other_edge++, c->EdgeOri(i));
+}
+
+// Permutation of the middle layer edges in the middle layer (phase 2 only)
+inline int GetSlicePerm(const CubieCube& c)
+{
+    int perm[4];
+    for (int i = 0; i < 4; i++)
+        perm[i] = c.EdgePerm(FR + i) - FR;
+    return int(RankPartialPerm(perm, 4, 4));
+}
+
+inline void SetSlicePerm(CubieCube* c, int index)
+{
+    int perm[4];
+    UnrankPartialPerm(uint32_t(index), 4, 4, perm);
+    for (int i = 0; i < 4; i++)
+        c->SetEdge(FR + i, perm[i] + FR, c->EdgeOri(FR + i));
+}
+
+// Permutation of the U and D layer edges in the U and D layers (phase 2 only)
+inline int GetUDEdgePerm(const CubieCube& c)
+{
+    int perm[8];
+    for (int i = 0; i < 8; i++)
+        perm[i] = c.EdgePerm(i);
+    return int(RankPartialPerm(perm, 8, 8));
+}
+
+inline void SetUDEdgePerm(CubieCube* c, int index)
+{
+    int perm[8];
+    UnrankPartialPerm(uint32_t(index), 8, 8, perm);
+    for (int i = 0; i < 8; i++)
+        c->SetEdge(i, perm[i], c->EdgeOri(i));
+}
+
+// Build a move table of a coordinate.
+// table[i * move_num + m] is the coordinate after move move_ids[m] from coordinate i.
+template <typename GetFunc, typename SetFunc>
+void BuildMoveTable(const CubieCube* moves, const int* move_ids, int move_num,
+                    int size, GetFunc get, SetFunc set, std::vector<uint16_t>* table)
+{
+    table->resize(size_t(size) * move_num);
+    for (int i = 0; i < size; i++) {
+        CubieCube c;
+        set(&c, i);
+        for (int m = 0; m < move_num; m++) {
+            CubieCube moved;
+            CubieCube::Multiply(c, moves[move_ids[m]], &moved);
+            (*table)[size_t(i) * move_num + m] = uint16_t(get(moved));
+        }
+    }
+}
+
+}  // namespace coord
+}  // namespace rubiks
@@ -0,0 +1,359 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include "rubiks.hpp"
+
+namespace rubiks {
+
+// Faces in standard notation.
+// U is the white face on top of the initial view, and F faces the camera.
+enum NotationFace : int {
+    FACE_U = 0,
+    FACE_R,
+    FACE_F,
+    FACE_D,
+    FACE_L,
+    FACE_B
+};
+
+// CubeFaceIndices of each NotationFace
+const int NOTATION_FACES[6] = {
+    FACE_Y_MINUS, FACE_X_PLUS, FACE_Z_MINUS,
+    FACE_Y_PLUS, FACE_X_MINUS, FACE_Z_PLUS
+};
+
+enum Corner : int { URF = 0, UFL, ULB, UBR, DFR, DLF, DBL, DRB };
+enum Edge : int { UR = 0, UF, UL, UB, DR, DF, DL, DB, FR, FL, BL, BR };
+
+// Faces of corner stickers. They are listed clockwise from the U or D sticker.
+const int CORNER_FACES[8][3] = {
+    { FACE_U, FACE_R, FACE_F }, { FACE_U, FACE_F, FACE_L },
+    { FACE_U, FACE_L, FACE_B }, { FACE_U, FACE_B, FACE_R },
+    { FACE_D, FACE_F, FACE_R }, { FACE_D, FACE_L, FACE_F },
+    { FACE_D, FACE_B, FACE_L }, { FACE_D, FACE_R, FACE_B }
+};
+
+// Faces of edge stickers. The first one decides the orientation.
+const int EDGE_FACES[12][2] = {
+    { FACE_U, FACE_R }, { FACE_U, FACE_F }, { FACE_U, FACE_L }, { FACE_U, FACE_B },
+    { FACE_D, FACE_R }, { FACE_D, FACE_F }, { FACE_D, FACE_L }, { FACE_D, FACE_B },
+    { FACE_F, FACE_R }, { FACE_F, FACE_L }, { FACE_B, FACE_L }, { FACE_B, FACE_R }
+};
+
+// Convert a face turn to a layer rotation of RubiksCube.
+// turns is the number of clockwise quarter turns (1 to 3).
+inline void FaceTurnToLayerMove(int cube_num, int face, int depth, int turns,
+                                int *axis, int *layer, int *degree)
+{
+    // Clockwise turns of U, F, and L are 90 degree rotations around their axes.
+    // The opposite faces turn in the other direction.
+    int cube_face = NOTATION_FACES[face];
+    *axis = FaceAxis(cube_face);
+    bool minus_side = cube_face == FACE_X_MINUS ||
+                      cube_face == FACE_Y_MINUS ||
+                      cube_face == FACE_Z_MINUS;
+    *layer = minus_side ? depth : cube_num - 1 - depth;
+    *degree = minus_side ? turns : 4 - turns;
+}
+
+// Index of a sticker of a 3x3 cube in RubiksCube::facelets
+inline int CubieFaceletIndex(int face, const int* faces, int face_num)
+{
+    int xyz[3] = { 1, 1, 1 };
+    for (int i = 0; i < face_num; i++) {
+        int f = NOTATION_FACES[faces[i]];
+        int pos = (f == FACE_X_PLUS || f == FACE_Y_PLUS || f == FACE_Z_PLUS) ? 2 : 0;
+        xyz[FaceAxis(f) - 1] = pos;
+    }
+    return FaceletIndex(3, NOTATION_FACES[face], xyz[0], xyz[1], xyz[2]);
+}
+
+// Logical state of a 3x3 cube at the cubie level.
+// Each corner byte has the cubie in the low 3 bits and its orientation (0-2) above them.
+// Each edge byte has the cubie in the low 4 bits and its orientation (0-1) above them.
+// Stickers are read relative to the centers, so states after slice moves or
+// whole cube rotations are read as the face turns that give the same colors around the centers.
+struct CubieCube {
+    uint8_t corners[8];
+    uint8_t edges[12];
+
+    CubieCube()
+    {
+        SetSolved();
+    }
+
+    void SetSolved()
+    {
+        for (int i = 0; i < 8; i++)
+            corners[i] = uint8_t(i);
+        for (int i = 0; i < 12; i++)
+            edges[i] = uint8_t(i);
+    }
+
+    int CornerPerm(int i) const { return corners[i] & 7; }
+    int CornerOri(int i) const { return corners[i] >> 3; }
+    int EdgePerm(int i) const { return edges[i] & 15; }
+    int EdgeOri(int i) const { return edges[i] >> 4; }
+
+    void SetCorner(int i, int perm, int ori)
+    {
+        corners[i] = uint8_t(perm | (ori << 3));
+    }
+
+    void SetEdge(int i, int perm, int ori)
+    {
+        edges[i] = uint8_t(perm | (ori << 4));
+    }
+
+    // Apply b after this state.
+    void Multiply(const CubieCube& b)
+    {
+        CubieCube result;
+        Multiply(*this, b, &result);
+        *this = result;
+    }
+
+    // result = a * b (apply a, then b)
+    static void Multiply(const CubieCube& a, const CubieCube& b, CubieCube* result)
+    {
+        static const uint8_t MOD3[6] = { 0, 1, 2, 0, 1, 2 };
+        for (int i = 0; i < 8; i++) {
+            uint8_t bc = b.corners[i];
+            uint8_t ac = a.corners[bc & 7];
+            result->corners[i] = uint8_t((ac & 7) | (MOD3[(ac >> 3) + (bc >> 3)] << 3));
+        }
+        for (int i = 0; i < 12; i++) {
+            uint8_t be = b.edges[i];
+            uint8_t ae = a.edges[be & 15];
+            result->edges[i] = uint8_t(ae ^ (be & 16));
+        }
+    }
+
+    CubieCube Inverse() const
+    {
+        CubieCube inv;
+        for (int i = 0; i < 8; i++)
+            inv.SetCorner(CornerPerm(i), i, (3 - CornerOri(i)) % 3);
+        for (int i = 0; i < 12; i++)
+            inv.SetEdge(EdgePerm(i), i, EdgeOri(i));
+        return inv;
+    }
+
+    // Check if the state is reachable from the solved state.
+    bool IsValid() const
+    {
+        int corner_found = 0;
+        int edge_found = 0;
+        int twist = 0;
+        int flip = 0;
+        for (int i = 0; i < 8; i++) {
+            corner_found |= 1 << CornerPerm(i);
+            if (CornerOri(i) > 2)
+                return false;
+            twist += CornerOri(i);
+        }
+        for (int i = 0; i < 12; i++) {
+            if (EdgePerm(i) > 11 || EdgeOri(i) > 1)
+                return false;
+            edge_found |= 1 << EdgePerm(i);
+            flip += EdgeOri(i);
+        }
+        return corner_found == 0xFF && edge_found == 0xFFF &&
+               twist % 3 == 0 && flip % 2 == 0 &&
+               CornerParity() == EdgeParity();
+    }
+
+    int CornerParity() const
+    {
+        int parity = 0;
+        for (int i = 0; i < 8; i++)
+            for (int j = i + 1; j < 8; j++)
+                parity ^= CornerPerm(i) > CornerPerm(j);
+        return parity;
+    }
+
+    int EdgeParity() const
+    {
+        int parity = 0;
+        for (int i = 0; i < 12; i++)
+            for (int j = i + 1; j < 12; j++)
+                parity ^= EdgePerm(i) > EdgePerm(j);
+        return parity;
+    }
+
+    // Read a 3x3 facelet array of RubiksCube.
+    // Each color is replaced with the face whose center has it,
+    // so outer face turns of the result solve the cube in its current orientation.
+    // It returns false if the stickers don't make up valid cubies.
+    bool FromFacelets(const uint8_t* stickers)
+    {
+        int faces[6] = { -1, -1, -1, -1, -1, -1 };  // face of the center of each color
+        for (int f = 0; f < 6; f++) {
+            int color = stickers[f * 9 + 4];
+            if (color > 5 || faces[color] >= 0)
+                return false;
+            faces[color] = f;
+        }
+        uint8_t facelets[54];
+        for (int i = 0; i < 54; i++) {
+            if (stickers[i] > 5)
+                return false;
+            facelets[i] = uint8_t(faces[stickers[i]]);
+        }
+
+        for (int i = 0; i < 8; i++) {
+            int colors[3];
+            for (int j = 0; j < 3; j++)
+                colors[j] = facelets[CubieFaceletIndex(CORNER_FACES[i][j], CORNER_FACES[i], 3)];
+            int ori = 0;
+            while (ori < 3 && colors[ori] != NOTATION_FACES[FACE_U] &&
+                   colors[ori] != NOTATION_FACES[FACE_D])
+                ori++;
+            if (ori == 3)
+                return false;
+            int perm = -1;
+            for (int j = 0; j < 8; j++) {
+                if (colors[(ori + 1) % 3] == NOTATION_FACES[CORNER_FACES[j][1]] &&
+                    colors[(ori + 2) % 3] == NOTATION_FACES[CORNER_FACES[j][2]])
+                    perm = j;
+            }
+            if (perm < 0)
+                return false;
+            SetCorner(i, perm, ori);
+        }
+        for (int i = 0; i < 12; i++) {
+            int color0 = facelets[CubieFaceletIndex(EDGE_FACES[i][0], EDGE_FACES[i], 2)];
+            int color1 = facelets[CubieFaceletIndex(EDGE_FACES[i][1], EDGE_FACES[i], 2)];
+            int perm = -1;
+            int ori = 0;
+            for (int j = 0; j < 12; j++) {
+                int face0 = NOTATION_FACES[EDGE_FACES[j][0]];
+                int face1 = NOTATION_FACES[EDGE_FACES[j][1]];
+                if (color0 == face0 && color1 == face1) {
+                    perm = j;
+                    ori = 0;
+                } else if (color0 == face1 && color1 == face0) {
+                    perm = j;
+                    ori = 1;
+                }
+            }
+            if (perm < 0)
+                return false;
+            SetEdge(i, perm, ori);
+        }
+        return IsValid();
+    }
+
+    // Write stickers to a 3x3 facelet array of RubiksCube.
+    // Centers are set to the solved state.
+    void ToFacelets(uint8_t* facelets) const
+    {
+        for (int f = 0; f < 6; f++)
+            facelets[f * 9 + 4] = uint8_t(f);  // center of each face
+        for (int i = 0; i < 8; i++) {
+            int perm = CornerPerm(i);
+            int ori = CornerOri(i);
+            for (int j = 0; j < 3; j++) {
+                int facelet = CubieFaceletIndex(CORNER_FACES[i][(j + ori) % 3], CORNER_FACES[i], 3);
+                facelets[facelet] = uint8_t(NOTATION_FACES[CORNER_FACES[perm][j]]);
+            }
+        }
+        for (int i = 0; i < 12; i++) {
+            int perm = EdgePerm(i);
+            int ori = EdgeOri(i);
+            for (int j = 0; j < 2; j++) {
+                int facelet = CubieFaceletIndex(EDGE_FACES[i][(j + ori) % 2], EDGE_FACES[i], 2);
+                facelets[facelet] = uint8_t(NOTATION_FACES[EDGE_FACES[perm][j]]);
+            }
+        }
+    }
+
+    bool FromRubiksCube(const RubiksCube& rubiks)
+    {
+        if (rubiks.cube_num != 3)
+            return false;
+        return FromFacelets(rubiks.facelets.data());
+    }
+
+    void ToRubiksCube(RubiksCube& rubiks) const
+    {
+        if (rubiks.cube_num == 3) {
+            ToFacelets(rubiks.facelets.data());
+            rubiks.InvalidateColors();
+        }
+    }
+
+    // The whole state in two 64-bit words.
+    // The first one has corners (40 bits) and the second one has edges (60 bits).
+    void GetKey(uint64_t* key) const
+    {
+        key[0] = 0;
+        key[1] = 0;
+        for (int i = 0; i < 8; i++)
+            key[0] |= uint64_t(corners[i]) << (i * 5);
+        for (int i = 0; i < 12; i++)
+            key[1] |= uint64_t(edges[i]) << (i * 5);
+    }
+
+    size_t Hash() const
+    {
+        uint64_t key[2];
+        GetKey(key);
+        uint64_t h = key[0] * 0x9E3779B97F4A7C15ULL ^ key[1];
+        h ^= h >> 32;
+        h *= 0xD6E8FEB86659FD93ULL;
+        h ^= h >> 32;
+        return size_t(h);
+    }
+
+    bool operator==(const CubieCube& c) const
+    {
+        return std::memcmp(this, &c, sizeof(CubieCube)) == 0;
+    }
+
+    bool operator!=(const CubieCube& c) const
+    {
+        return !(*this == c);
+    }
+};
+
+// Face turns are numbered as face * 3 + turns - 1.
+// e.g. 0: U, 1: U2, 2: U', 3: R, ...
+const int FACE_TURN_NUM = 18;
+
+inline int FaceTurn(int face, int turns)
+{
+    return face * 3 + turns - 1;
+}
+
+// Get cubie level moves of the 18 face turns.
+// They are taken from the facelet move table of RubiksCube,
+// so solvers always agree with the rotations the app animates.
+inline void BuildFaceTurnCubes(CubieCube* moves)
+{
+    FaceletMoveTable table;
+    table.Build(3);
+    std::vector<uint8_t> work(table.max_move_size);
+    for (int face = 0; face < 6; face++) {
+        for (int turns = 1; turns <= 3; turns++) {
+            uint8_t facelets[54];
+            for (int i = 0; i < 54; i++)
+                facelets[i] = uint8_t(i / 9);
+            int axis, layer, degree;
+            FaceTurnToLayerMove(3, face, 0, turns, &axis, &layer, &degree);
+            table.Apply(table.MoveIndex(axis, layer, degree), facelets, work.data());
+            moves[FaceTurn(face, turns)].FromFacelets(facelets);
+        }
+    }
+}
+
+// Hash function for std::unordered_set and std::unordered_map
+struct CubieCubeHash {
+    size_t operator()(const CubieCube& c) const
+    {
+        return c.Hash();
+    }
+};
+
+}  // namespace rubiks
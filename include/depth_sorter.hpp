@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "geometry.hpp"
+
+namespace rubiks {
+
+// Sorts visible faces from far to near like geometry::Zsort,
+// starting from the order of the previous frame.
+//
+// Camera moves and layer turns change the order only a little between frames,
+// so insertion sort repairs it in almost linear time.
+// Faces that became visible are sorted separately and merged into the order.
+// When the order changes a lot, it falls back to a radix sort on quantized depth.
+class DepthSorter {
+ private:
+    // Depth is copied next to the index, so sorting doesn't jump around visible_faces.
+    struct Item {
+        double z;
+        uint32_t face;  // index in visible_faces
+        uint32_t key;  // radix key
+    };
+
+    std::vector<int> m_order;  // face ids of the last frame from far to near
+    // Faces of the current frame by id. face is the index + 1 in visible_faces, or 0 for none.
+    std::vector<Item> m_by_id;
+    std::vector<Item> m_kept;  // faces that were visible in the last frame
+    std::vector<Item> m_added;  // faces that became visible
+    std::vector<Item> m_merged;
+    std::vector<Item> m_radix_work;
+    std::vector<Quad> m_sorted;
+    size_t m_radix_count;
+
+    // It gives up and returns false when it takes more than max_shifts moves.
+    static bool InsertionSort(std::vector<Item>& items, size_t max_shifts);
+
+    void RadixSort(std::vector<Item>& items);
+
+    // Insertion sort for nearly sorted items, and radix sort for others
+    void SortItems(std::vector<Item>& items);
+
+ public:
+    // Insertion sort can move each face this many times on average before the fallback.
+    static const size_t MAX_SHIFTS_PER_FACE = 8;
+    // The last order is used when less than 1/MIN_SORTED_RATIO of neighbors are out of order.
+    static const size_t MIN_SORTED_RATIO = 4;
+
+    DepthSorter() : m_radix_count(0) {}
+
+    void Sort(FrameContext& frame);
+
+    // Forget the last order. The next frame is sorted from scratch.
+    void Reset();
+
+    // Number of radix sorts, e.g. to see how often the fallback runs
+    size_t RadixCount() const
+    {
+        return m_radix_count;
+    }
+};
+
+}  // namespace rubiks
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "geometry.hpp"
+
+namespace rubiks {
+
+// Faces that a backend can fill with one path and one brush
+struct DrawBatch {
+    uint32_t color;
+    size_t first;  // index in DrawBatcher::Faces()
+    size_t count;
+};
+
+struct BatchedFace {
+    uint32_t face;  // index in visible_faces
+    // The face winds the other way on the screen than faces with false,
+    // so it should be drawn from v4 to v1.
+    bool reversed;
+};
+
+// Groups sorted visible faces into runs of the same color,
+// so backends with costly draw calls can fill each run at once.
+//
+// A face joins the last batch of its color when it doesn't overlap
+// any face of the later batches. Drawing the batches in order then gives
+// the same image as drawing the faces in order.
+// Faces of a batch can overlap each other. BatchedFace::reversed orients
+// all of them the same way, so a nonzero winding fill draws their union.
+class DrawBatcher {
+ private:
+    // Face in projected coordinates
+    struct Bounds {
+        double left;
+        double top;
+        double right;
+        double bottom;
+    };
+
+    std::vector<DrawBatch> m_batches;
+    std::vector<BatchedFace> m_faces;
+    std::vector<uint32_t> m_batch_of;  // batch index of each visible face
+    std::vector<Bounds> m_bounds;
+    std::vector<bool> m_reversed;
+    std::vector<std::pair<uint32_t, uint32_t>> m_last_batches;  // color and the last batch of it
+    // Visible faces whose bounds touch each cell, in the order of the frame
+    std::vector<std::vector<uint32_t>> m_cells;
+    int m_grid_size;  // number of cells on each side
+    double m_grid_left;
+    double m_grid_top;
+    double m_cell_scale;  // cells per unit length
+
+    // Cells touched by bounds
+    void CellRange(const Bounds& b, int* x_begin, int* y_begin, int* x_end, int* y_end) const;
+
+    // It returns true when the face overlaps a face in a batch after the batch.
+    bool IsCovered(const FrameContext& frame, uint32_t face, uint32_t batch) const;
+
+ public:
+    // Faces to check for each face before giving up and starting a new batch.
+    // It keeps batching linear for large cubes.
+    static const size_t MAX_CHECKS_PER_FACE = 256;
+
+    DrawBatcher() : m_grid_size(0), m_grid_left(0), m_grid_top(0), m_cell_scale(0) {}
+
+    // Batch visible faces of a frame sorted by Zsort or DepthSorter.
+    const std::vector<DrawBatch>& Batch(const FrameContext& frame);
+
+    const std::vector<DrawBatch>& Batches() const
+    {
+        return m_batches;
+    }
+
+    // Faces grouped by batch
+    const std::vector<BatchedFace>& Faces() const
+    {
+        return m_faces;
+    }
+};
+
+// Returns true if two convex quads share some area.
+// Quads that only touch at edges don't overlap.
+bool QuadsOverlap(const VertexArray& vertices, const Quad& a, const Quad& b);
+
+}  // namespace rubiks
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "span_fill.hpp"
+
+namespace rubiks {
+
+// Pack a 0xRRGGBB color into a pixel whose bytes are R, G, B, A in memory
+inline uint32_t PackPixel(uint32_t color, uint8_t alpha = 255)
+{
+    const uint8_t bytes[4] = {
+        uint8_t(color >> 16), uint8_t(color >> 8), uint8_t(color), alpha
+    };
+    uint32_t pixel;
+    memcpy(&pixel, bytes, 4);
+    return pixel;
+}
+
+// RGBA image in memory. Rows are stored from top to bottom without padding.
+struct Framebuffer {
+    int width;
+    int height;
+    std::vector<uint32_t> pixels;  // PackPixel() values
+
+    Framebuffer() : width(0), height(0) {}
+
+    void Resize(int w, int h)
+    {
+        width = w;
+        height = h;
+        pixels.resize(size_t(w) * size_t(h));
+    }
+
+    void Clear(uint32_t pixel)
+    {
+        simd::FillSpan(pixels.data(), pixels.size(), pixel);
+    }
+
+    uint32_t* Row(int y)
+    {
+        return pixels.data() + size_t(y) * size_t(width);
+    }
+
+    const uint32_t* Row(int y) const
+    {
+        return pixels.data() + size_t(y) * size_t(width);
+    }
+
+    // Binary PPM (P6). Alpha is dropped.
+    // It returns false if the file can't be written.
+    bool SavePPM(const std::string& path) const;
+
+    // PNG with uncompressed (stored) deflate blocks, so it needs no zlib
+    bool SavePNG(const std::string& path) const;
+
+    // PNG for paths ending with ".png", PPM otherwise
+    bool Save(const std::string& path) const;
+};
+
+}  // namespace rubiks
@@ -1,8 +1,9 @@
 #pragma once
 #include <cmath>
 #include <algorithm>
-#include <iterator>
+#include <cstdint>
 #include <vector>
+#include "simd.hpp"
 
 struct Vec3D {
     double x;
@@ -105,14 +106,6 @@ struct Vec3D {
         z /= s;
         return *this;
     }
-
-    Vec3D& operator =(const Vec3D& v)
-    {
-        x = v.x;
-        y = v.y;
-        z = v.z;
-        return *this;
-    }
 };
 
 struct Matrix3D {
@@ -202,19 +195,37 @@ struct Matrix3D {
         double z = m31 * v.x + m32 * v.y + m33 * v.z;
         return { x, y, z };
     }
+};
 
-    Matrix3D& operator=(const Matrix3D& A)
+// Vertices stored as separate x, y, z arrays (structure of arrays)
+// so they can be transformed in batches with SIMD instructions.
+struct VertexArray {
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> z;
+
+    size_t Size() const
     {
-        m11 = A.m11;
-        m12 = A.m12;
-        m13 = A.m13;
-        m21 = A.m21;
-        m22 = A.m22;
-        m23 = A.m23;
-        m31 = A.m31;
-        m32 = A.m32;
-        m33 = A.m33;
-        return *this;
+        return x.size();
+    }
+
+    void Resize(size_t n)
+    {
+        x.resize(n);
+        y.resize(n);
+        z.resize(n);
+    }
+
+    void Push(const Vec3D& v)
+    {
+        x.push_back(v.x);
+        y.push_back(v.y);
+        z.push_back(v.z);
+    }
+
+    Vec3D Get(size_t i) const
+    {
+        return { x[i], y[i], z[i] };
     }
 };
 
@@ -228,6 +239,7 @@ struct Quad {
     int v4;
     uint32_t color;
     double z;  // it can store depth for z sorting
+    int id;  // index of the face in the scene, which stays the same between frames
 
     void IncIndices(int inc)
     {
@@ -238,8 +250,31 @@ struct Quad {
     }
 };
 
+// Buffers for projected vertices and visible faces.
+// They are sized once and reused by every frame,
+// so a steady-state frame does no heap allocations.
+struct FrameContext {
+    VertexArray projected_vertices;
+    std::vector<Quad> visible_faces;
+    size_t visible_face_count;  // number of valid elements in visible_faces
+
+    FrameContext() : visible_face_count(0) {}
+
+    void Resize(size_t vertex_count, size_t face_count)
+    {
+        projected_vertices.Resize(vertex_count);
+        visible_faces.resize(face_count);
+        visible_face_count = 0;
+    }
+
+    void Clear()
+    {
+        visible_face_count = 0;
+    }
+};
+
 struct QuadModel {
-    std::vector<Vec3D> vertices;
+    VertexArray vertices;
     std::vector<Quad> faces;
     Matrix3D rotation;
     Vec3D translation;
@@ -249,7 +284,7 @@ struct QuadModel {
 
     void AddVertex(const Vec3D& v)
     {
-        vertices.push_back(v);
+        vertices.Push(v);
     }
 
     void AddFace(const Quad& f)
@@ -257,51 +292,83 @@ struct QuadModel {
         faces.push_back(f);
     }
 
-    void Project(
+    // Append faces[i] to visible faces of the frame.
+    // Its vertices must be in projected_vertices[vertex_offset...].
+    void AppendFace(
+        size_t i,
+        int vertex_offset,
+        int face_offset,
+        FrameContext& frame,
+        const uint32_t* colors = nullptr) const
+    {
+        const Quad& f = faces[i];
+        const double* pz = frame.projected_vertices.z.data() + vertex_offset;
+        Quad& copied_f = frame.visible_faces[frame.visible_face_count++];
+        copied_f = f;
+        copied_f.z = (pz[f.v1] + pz[f.v2] + pz[f.v3] + pz[f.v4]) / 4;  // store center point for z sorting
+        copied_f.IncIndices(vertex_offset);
+        copied_f.id = face_offset + int(i);
+        if (colors)
+            copied_f.color = colors[i];
+    }
+
+    // Project vertices to projected_vertices[vertex_offset...]
+    // and append visible faces to the frame buffer.
+    // Face ids start from face_offset.
+    // colors can override the colors of faces.
+    // Faces out of face_mask (bit i for faces[i]) are skipped without the back-face test.
+    // It returns the mask of visible faces.
+    uint32_t Project(
         const Matrix3D& global_rotation,
         const Vec3D& global_translation,
-        std::vector<Vec3D>& projected_vertices,
-        std::vector<Quad>& visible_faces)
+        int vertex_offset,
+        int face_offset,
+        FrameContext& frame,
+        const uint32_t* colors = nullptr,
+        uint32_t face_mask = ~0u) const
     {
+        // Fuse the local and global transforms into one affine matrix.
+        // global_rotation * (rotation * v * scale + translation) + global_translation
+        Matrix3D m = global_rotation * rotation * scale;
+        Vec3D t = global_rotation * translation + global_translation;
+        const double affine[12] = {
+            m.m11, m.m12, m.m13, t.x,
+            m.m21, m.m22, m.m23, t.y,
+            m.m31, m.m32, m.m33, t.z
+        };
+
         // Calculate projected coordinates
-        std::vector<Vec3D> new_projected_vertices;
-        for (const Vec3D& v : vertices) {
-            Vec3D local_vec = rotation * v * scale + translation;
-            Vec3D global_vec = global_rotation * local_vec + global_translation;
-            new_projected_vertices.push_back(global_vec);
-        }
+        VertexArray& projected = frame.projected_vertices;
+        double* px = projected.x.data() + vertex_offset;
+        double* py = projected.y.data() + vertex_offset;
+        double* pz = projected.z.data() + vertex_offset;
+        simd::TransformAffine(affine,
+                              vertices.x.data(), vertices.y.data(), vertices.z.data(),
+                              px, py, pz, vertices.Size());
 
         // Collect visible faces
-        std::vector<Quad> new_visible_faces;
-        for (Quad& f : faces) {
-            Vec3D v1 = new_projected_vertices[f.v1];
-            Vec3D v2 = new_projected_vertices[f.v2];
-            Vec3D v3 = new_projected_vertices[f.v3];
-            Vec3D cross_prod = (v2 - v1).Cross(v3 - v2);
-            if (cross_prod.z <= 0) {
+        uint32_t visible_mask = 0;
+        for (size_t i = 0; i < faces.size(); i++) {
+            if (!(face_mask & (1u << i)))
+                continue;
+            const Quad& f = faces[i];
+            // z element of (v2 - v1) x (v3 - v2)
+            double cross_z = (px[f.v2] - px[f.v1]) * (py[f.v3] - py[f.v2]) -
+                             (py[f.v2] - py[f.v1]) * (px[f.v3] - px[f.v2]);
+            if (cross_z <= 0) {
                 // invisible
                 continue;
             }
-            Vec3D v4 = new_projected_vertices[f.v4];
-            Quad copied_f = f;
-            copied_f.z = (v1.z + v2.z + v3.z + v4.z) / 4;  // store center point for z sorting
-            copied_f.IncIndices(projected_vertices.size());
-            new_visible_faces.push_back(copied_f);
+            AppendFace(i, vertex_offset, face_offset, frame, colors);
+            visible_mask |= 1u << i;
         }
-
-        // Concatnate vectors
-        std::copy(new_projected_vertices.begin(),
-                  new_projected_vertices.end(),
-                  std::back_inserter(projected_vertices));
-        std::copy(new_visible_faces.begin(),
-                  new_visible_faces.end(),
-                  std::back_inserter(visible_faces));
+        return visible_mask;
     }
 };
 
 namespace geometry {
 
-const Matrix3D Zero()
+inline const Matrix3D Zero()
 {
     return {
         0, 0, 0,
@@ -310,7 +377,7 @@ const Matrix3D Zero()
     };
 }
 
-const Matrix3D Identity()
+inline const Matrix3D Identity()
 {
     return {
         1, 0, 0,
@@ -319,7 +386,7 @@ const Matrix3D Identity()
     };
 }
 
-const Matrix3D RotationX(double theta)
+inline const Matrix3D RotationX(double theta)
 {
     double s = std::sin(theta);
     double c = std::cos(theta);
@@ -330,7 +397,7 @@ const Matrix3D RotationX(double theta)
     };
 }
 
-const Matrix3D RotationY(double theta)
+inline const Matrix3D RotationY(double theta)
 {
     double s = std::sin(theta);
     double c = std::cos(theta);
@@ -341,7 +408,7 @@ const Matrix3D RotationY(double theta)
     };
 }
 
-const Matrix3D RotationZ(double theta)
+inline const Matrix3D RotationZ(double theta)
 {
     double s = std::sin(theta);
     double c = std::cos(theta);
@@ -357,10 +424,11 @@ static bool CompDepth(const Quad& q1, const Quad& q2)
     return (q1.z > q2.z);
 }
 
-void Zsort(std::vector<Quad>& visible_faces)
+inline void Zsort(FrameContext& frame)
 {
     // Sort faces by depth in ascending order
-    std::sort(visible_faces.begin(), visible_faces.end(), CompDepth);
+    Quad* faces = frame.visible_faces.data();
+    std::sort(faces, faces + frame.visible_face_count, CompDepth);
 }
 
 }  // namespace geometry
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "notation.hpp"
+#include "rubiks.hpp"
+
+// Move sequences compiled for a cube size, to replay long move logs quickly.
+namespace rubiks {
+
+// Layer rotations as indices of FaceletMoveTable.
+//
+// Moves are merged while they are appended. Turns of layers on the same axis
+// commute, so the last run of instructions on one axis keeps at most one turn
+// for each layer: R R' cancels out, R R becomes R2, and R L R' becomes L.
+class MoveProgram {
+ private:
+    int m_cube_num;
+    std::vector<uint16_t> m_code;
+    size_t m_run_start;  // first instruction of the last run on one axis
+    size_t m_appended;  // layer rotations before merging
+
+    int InstructionAxis(uint16_t instruction) const
+    {
+        return instruction / 3 / m_cube_num + 1;
+    }
+
+ public:
+    MoveProgram() : m_cube_num(0), m_run_start(0), m_appended(0) {}
+
+    // Clear the program and compile for another cube size
+    void Reset(int cube_num);
+
+    int CubeNum() const
+    {
+        return m_cube_num;
+    }
+
+    // Append a layer rotation, as RubiksCube::RotateLayer takes.
+    void AppendLayerMove(int axis, int layer, int degree);
+
+    // Append moves parsed by ParseMoves() for the cube size
+    void Append(const NotationMove& move);
+    void Append(const std::vector<NotationMove>& moves);
+
+    const std::vector<uint16_t>& Code() const
+    {
+        return m_code;
+    }
+
+    // Layer rotations appended since Reset(), including merged ones
+    size_t AppendedMoves() const
+    {
+        return m_appended;
+    }
+
+    // Run instructions on facelets of a cube of the same size.
+    // work should have table.max_move_size elements.
+    void Apply(const FaceletMoveTable& table, uint8_t* facelets, uint8_t* work,
+               size_t begin, size_t end) const;
+
+    // Run instructions from begin to end on a cube.
+    // It returns false if the cube has another size.
+    bool Apply(RubiksCube* rubiks, size_t begin, size_t end) const;
+
+    bool Apply(RubiksCube* rubiks) const
+    {
+        return Apply(rubiks, 0, m_code.size());
+    }
+};
+
+// Parse moves and compile them into a program.
+// It returns false if ParseMoves() fails.
+bool CompileMoves(const std::string& text, int cube_num, MoveProgram* program);
+
+}  // namespace rubiks
@@ -0,0 +1,205 @@
+#pragma once
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "cubie.hpp"
+
+// Face turns in standard notation, such as "R U R' U2".
+namespace rubiks {
+
+const char NOTATION_FACE_NAMES[] = "URFDLB";
+
+// Parse face turns into FaceTurn() numbers.
+// It returns false if the text has an unknown move.
+inline bool ParseFaceTurns(const std::string& text, std::vector<int>* moves)
+{
+    moves->clear();
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i++];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            continue;
+        const char* name = strchr(NOTATION_FACE_NAMES, c);
+        if (c == '\0' || name == nullptr)
+            return false;
+        int turns = 1;
+        if (i < text.size() && text[i] == '2') {
+            turns = 2;
+            i++;
+        }
+        if (i < text.size() && text[i] == '\'') {
+            turns = 4 - turns;
+            i++;
+        }
+        moves->push_back(FaceTurn(int(name - NOTATION_FACE_NAMES), turns));
+    }
+    return true;
+}
+
+inline std::string FormatFaceTurns(const std::vector<int>& moves)
+{
+    static const char* SUFFIXES[3] = { "", "2", "'" };
+    std::string text;
+    for (int move : moves) {
+        if (!text.empty())
+            text += ' ';
+        text += NOTATION_FACE_NAMES[move / 3];
+        text += SUFFIXES[move % 3];
+    }
+    return text;
+}
+
+// Apply face turns to a cube of any size
+inline void ApplyFaceTurns(RubiksCube* rubiks, const std::vector<int>& moves)
+{
+    for (int move : moves) {
+        int axis, layer, degree;
+        FaceTurnToLayerMove(rubiks->cube_num, move / 3, 0, move % 3 + 1, &axis, &layer, &degree);
+        rubiks->RotateLayer(axis, layer, degree);
+    }
+}
+
+// A move in notation for cubes of any size
+//   R U' F2       face turns
+//   Rw r 3Rw 3r   wide turns of the outer 2 (or n) layers
+//   3R            a single inner layer, counted from the face
+//   M E S         all inner layers, turned like L, D and F
+//   x y z         the whole cube, turned like R, U and F
+struct NotationMove {
+    char name;  // one of "URFDLBMESxyz"
+    int layers;  // number before the name, or 0 for none
+    bool wide;  // Rw or r
+    int turns;  // clockwise quarter turns (0 to 3)
+};
+
+// Face that a move turns like, and its layers as depths from that face
+inline void NotationMoveLayers(const NotationMove& move, int cube_num,
+                               int* face, int* first_depth, int* last_depth)
+{
+    const char* slice = strchr("MES", move.name);
+    const char* rotation = strchr("xyz", move.name);
+    if (slice) {
+        *face = (move.name == 'M') ? FACE_L : (move.name == 'E') ? FACE_D : FACE_F;
+        *first_depth = 1;
+        *last_depth = cube_num - 2;
+    } else if (rotation) {
+        *face = (move.name == 'x') ? FACE_R : (move.name == 'y') ? FACE_U : FACE_F;
+        *first_depth = 0;
+        *last_depth = cube_num - 1;
+    } else {
+        *face = int(strchr(NOTATION_FACE_NAMES, move.name) - NOTATION_FACE_NAMES);
+        if (move.wide) {
+            *first_depth = 0;
+            *last_depth = (move.layers > 0 ? move.layers : 2) - 1;
+        } else {
+            *first_depth = (move.layers > 0 ? move.layers : 1) - 1;
+            *last_depth = *first_depth;
+        }
+    }
+}
+
+// Notation of a layer rotation of RubiksCube, the inverse of FaceTurnToLayerMove().
+// The layer is counted from the nearer face, e.g. 2L rather than 4R on a 5x5 cube.
+inline NotationMove LayerMoveToNotation(int cube_num, int axis, int layer, int degree)
+{
+    NotationMove move = { 0, 0, false, 0 };
+    int best_depth = cube_num;
+    for (int face = 0; face < 6; face++) {
+        const int depths[2] = { layer, cube_num - 1 - layer };
+        for (int depth : depths) {
+            int a, l, d;
+            FaceTurnToLayerMove(cube_num, face, depth, 1, &a, &l, &d);
+            if (a != axis || l != layer || depth >= best_depth)
+                continue;
+            best_depth = depth;
+            move.name = NOTATION_FACE_NAMES[face];
+            move.layers = (depth > 0) ? depth + 1 : 0;
+            // d is 1 for a clockwise turn, or 3 if the face turns the other way
+            move.turns = (degree * d) % 4;
+        }
+    }
+    return move;
+}
+
+// Parse moves for a cube size.
+// It returns false if the text has an unknown move or layers that the cube doesn't have.
+// Spaces between moves are optional, and a number after a move is its turn count (R3 is R').
+inline bool ParseMoves(const std::string& text, int cube_num, std::vector<NotationMove>* moves)
+{
+    moves->clear();
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            i++;
+            continue;
+        }
+
+        NotationMove move = { 0, 0, false, 1 };
+        size_t prefix = i;
+        while (i < text.size() && isdigit((unsigned char)text[i]) && move.layers <= cube_num)
+            move.layers = move.layers * 10 + (text[i++] - '0');
+        bool has_prefix = i > prefix;
+        if (i == text.size() || (has_prefix && move.layers == 0))
+            return false;
+        c = text[i++];
+        if (c != '\0' && strchr(NOTATION_FACE_NAMES, c)) {
+            move.name = c;
+            if (i < text.size() && text[i] == 'w') {
+                move.wide = true;
+                i++;
+            }
+        } else if (c != '\0' && strchr("urfdlb", c)) {
+            move.name = char(toupper(c));
+            move.wide = true;
+        } else if (c != '\0' && strchr("MESxyz", c)) {
+            move.name = c;
+            if (has_prefix || cube_num < 3)
+                return false;
+        } else {
+            return false;
+        }
+
+        int face, first_depth, last_depth;
+        NotationMoveLayers(move, cube_num, &face, &first_depth, &last_depth);
+        if (last_depth >= cube_num)
+            return false;
+
+        int count = 1;
+        if (i < text.size() && isdigit((unsigned char)text[i])) {
+            count = 0;
+            while (i < text.size() && isdigit((unsigned char)text[i]))
+                count = (count * 10 + (text[i++] - '0')) % 4;
+        }
+        move.turns = count % 4;
+        if (i < text.size() && text[i] == '\'') {
+            move.turns = (4 - move.turns) % 4;
+            i++;
+        }
+        moves->push_back(move);
+    }
+    return true;
+}
+
+// Format moves for ParseMoves(). Moves with no turns (R4) are left out.
+inline std::string FormatMoves(const std::vector<NotationMove>& moves)
+{
+    static const char* SUFFIXES[4] = { "", "", "2", "'" };
+    std::string text;
+    for (const NotationMove& move : moves) {
+        if (move.turns == 0)
+            continue;
+        if (!text.empty())
+            text += ' ';
+        if (move.layers > 0 && !(move.wide && move.layers == 2))
+            text += std::to_string(move.layers);
+        text += move.name;
+        if (move.wide)
+            text += 'w';
+        text += SUFFIXES[move.turns];
+    }
+    return text;
+}
+
+}  // namespace rubiks
@@ -0,0 +1,190 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "coordinates.hpp"
+#include "cubie.hpp"
+#include "pruning_table.hpp"
+#include "symmetry.hpp"
+#include "table_cache.hpp"
+#include "thread_pool.hpp"
+
+namespace rubiks {
+
+// Called after each depth of breadth-first search while the table-th of table_num tables
+// is generated. visited is the number of states of the table found so far.
+typedef std::function<void(int table, int table_num, int depth, uint64_t visited, uint64_t size)>
+    TableProgress;
+
+// Phase 1 coordinates of TwoPhaseSolver with the order of the middle layer edges
+// (twist, flip and sorted slice), reduced by the 16 symmetries that keep the U-D axis.
+// The sorted slice falls into 788 classes. Flip and twist are conjugated by the symmetry
+// that takes the sorted slice to the representative of its class.
+struct Phase1Symmetry {
+    static const int FLIP_BITS_NUM = 4096;
+
+    std::vector<uint16_t> slice_class;  // [SLICE_SORTED_NUM]
+    std::vector<uint8_t> slice_sym;  // symmetry that takes it to the representative
+    std::vector<uint16_t> slice_mask;  // positions of the middle layer edges as bits
+    std::vector<uint16_t> class_rep;  // sorted slice of each class
+    std::vector<uint16_t> class_syms;  // bits of the symmetries that keep the representative
+    std::vector<uint16_t> twist_conj;  // [CORNER_ORI_NUM][UD_SYM_NUM]
+    std::vector<uint16_t> flip_conj;  // [UD_SYM_NUM][FLIP_BITS_NUM]: flip from orientation bits
+    std::vector<uint16_t> flip_bits;  // [EDGE_ORI_NUM]: orientation of each position as bits
+    uint16_t middle_flip[UD_SYM_NUM];  // bits a symmetry flips on middle layer edges (0 or all)
+    uint16_t other_flip[UD_SYM_NUM];  // the same for other edges
+
+    void Build(const Symmetries& syms);
+
+    uint64_t Size() const
+    {
+        return uint64_t(class_rep.size()) * coord::EDGE_ORI_NUM * coord::CORNER_ORI_NUM;
+    }
+
+    // Flip after symmetry s. The orientation a symmetry adds depends on the edge,
+    // so it needs the positions of the middle layer edges.
+    int ConjugateFlip(int flip, int mask, int s) const
+    {
+        int bits = flip_bits[flip] ^ (mask & middle_flip[s]) ^ (~mask & other_flip[s]);
+        return flip_conj[s * FLIP_BITS_NUM + (bits & (FLIP_BITS_NUM - 1))];
+    }
+
+    // Table index of a state: (class * EDGE_ORI_NUM + flip) * CORNER_ORI_NUM + twist.
+    // When symmetries keep the representative, the smallest index among them is used,
+    // so all symmetric states share one index.
+    uint64_t Index(int twist, int flip, int slice_sorted) const
+    {
+        int cls = slice_class[slice_sorted];
+        int sym = slice_sym[slice_sorted];
+        int f = ConjugateFlip(flip, slice_mask[slice_sorted], sym);
+        int t = twist_conj[twist * UD_SYM_NUM + sym];
+        int index = f * coord::CORNER_ORI_NUM + t;
+        uint16_t syms = class_syms[cls];
+        if (syms != 1) {
+            int mask = slice_mask[class_rep[cls]];
+            for (int s = 1; s < UD_SYM_NUM; s++) {
+                if (syms >> s & 1) {
+                    int i = ConjugateFlip(f, mask, s) * coord::CORNER_ORI_NUM +
+                            twist_conj[t * UD_SYM_NUM + s];
+                    index = std::min(index, i);
+                }
+            }
+        }
+        return uint64_t(cls) * coord::EDGE_ORI_NUM * coord::CORNER_ORI_NUM + uint64_t(index);
+    }
+};
+
+// Optimal solver for 3x3 cubes in the face turn metric.
+// It runs IDA* with one pattern database of Phase1Symmetry: 788 * 2^11 * 3^7 entries (1.6 GiB).
+// The table is looked up along the U-D, R-L and F-B axes for the cube and its inverse,
+// as in Kociemba's optimal solver.
+// See docs/Solvers.md for time and memory budgets.
+class OptimalSolver {
+ private:
+    CubieCube m_moves[FACE_TURN_NUM];
+    std::vector<uint16_t> m_corner_ori_move;  // [CORNER_ORI_NUM][FACE_TURN_NUM]
+    std::vector<uint16_t> m_edge_ori_move;  // [EDGE_ORI_NUM][FACE_TURN_NUM]
+    std::vector<uint16_t> m_slice_sorted_move;  // [SLICE_SORTED_NUM][FACE_TURN_NUM]
+    uint8_t m_corner_move[FACE_TURN_NUM][24];  // new position and orientation of a corner
+    uint8_t m_edge_move[FACE_TURN_NUM][32];  // new position and orientation of an edge
+    Symmetries m_syms;
+    int m_axis_moves[3][FACE_TURN_NUM];  // face turns seen along each axis
+    Phase1Symmetry m_phase1_sym;
+    PruningTable m_phase1_table;
+    MappedFile m_table_file;
+    bool m_initialized;
+
+    // state of the current search
+    struct Node {
+        // Inverse of the cube in CubieCube layout: position and orientation of each cubie
+        uint8_t corners[8];
+        uint8_t edges[12];
+        // Phase 1 coordinates of the cube conjugated by ROT_URF3^axis
+        uint16_t twist[3];
+        uint16_t flip[3];
+        uint16_t slice_sorted[3];
+    };
+
+    // A subtree under the first 2 moves
+    struct Task {
+        Node node;
+        int moves[2];
+    };
+
+    // Search state of each worker
+    struct Worker {
+        std::vector<int> path;
+        uint64_t node_count;
+    };
+
+    ThreadPool m_pool;
+    std::vector<Task> m_tasks;
+    std::vector<std::vector<int>> m_task_solutions;
+    std::vector<Worker> m_workers;
+    std::atomic<size_t> m_found_task;  // smallest task with a solution
+    std::atomic<bool> m_cancel;
+    uint64_t m_node_count;
+
+    void ApplyMove(const Node& node, int move, Node* child) const;
+    int Heuristic(const Node& node, int limit) const;
+    bool IsSolved(const Node& node) const;
+    bool Search(const Node& node, int depth, int bound, int last_face, size_t task, Worker* worker);
+    void MakeTasks(const Node& root, int bound);
+    void RunTask(size_t task, int bound, Worker* worker);
+
+ public:
+    // Searches run on thread_num threads (0 for all cores).
+    explicit OptimalSolver(int thread_num = 0);
+
+    // Build move tables and pattern databases.
+    // Pattern databases are loaded from cache_path if it has tables for the current moves.
+    // Otherwise, it takes minutes to generate them on the threads of the solver,
+    // and saves them to cache_path.
+    // Cancel() stops the generation. Then it returns false, and the next call starts over.
+    bool Initialize(const std::string& cache_path = "",
+                    const TableProgress& progress = TableProgress());
+
+    bool IsInitialized() const
+    {
+        return m_initialized;
+    }
+
+    int ThreadNum() const
+    {
+        return m_pool.ThreadNum();
+    }
+
+    static const int TABLE_NUM = 1;
+
+    // Pattern databases in the order of the table file
+    const PruningTable& Table(int i) const
+    {
+        const PruningTable* tables[TABLE_NUM] = { &m_phase1_table };
+        return *tables[i];
+    }
+
+    // Find a shortest solution. Moves are FaceTurn() numbers.
+    // It returns false if the cube is invalid, needs more than max_length moves,
+    // or the search is cancelled.
+    // Subtrees run in parallel, but the solution is the first one in the serial search order,
+    // so it's the same for any number of threads.
+    bool Solve(const CubieCube& cube, std::vector<int>* solution, int max_length = 20);
+
+    // Stop the running Solve() or Initialize() call. It can be called from any thread.
+    // If no search is running, the next Solve() call stops at once.
+    void Cancel()
+    {
+        m_cancel = true;
+    }
+
+    // Number of nodes visited by the last Solve() call
+    uint64_t NodeCount() const
+    {
+        return m_node_count;
+    }
+};
+
+}  // namespace rubiks
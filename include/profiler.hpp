@@ -0,0 +1,109 @@
+#pragma once
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Scoped timers for hot paths.
+// RUBIKS_PROFILE_SCOPE("Name") times the rest of the enclosing block.
+// The macro compiles to nothing unless RUBIKS_PROFILER is defined,
+// which is set by the "profiler" option of meson.
+#ifdef RUBIKS_PROFILER
+#define RUBIKS_PROFILE_CONCAT_INNER(a, b) a##b
+#define RUBIKS_PROFILE_CONCAT(a, b) RUBIKS_PROFILE_CONCAT_INNER(a, b)
+#define RUBIKS_PROFILE_SCOPE(name) \
+    static const int RUBIKS_PROFILE_CONCAT(profile_stage_, __LINE__) = \
+        rubiks::Profiler::Get().StageId(name); \
+    rubiks::ProfileScope RUBIKS_PROFILE_CONCAT(profile_scope_, __LINE__)( \
+        RUBIKS_PROFILE_CONCAT(profile_stage_, __LINE__))
+#else
+#define RUBIKS_PROFILE_SCOPE(name)
+#endif
+
+namespace rubiks {
+
+// Durations of a stage in seconds, over the last Profiler::WINDOW_SIZE samples
+struct StageStats {
+    const char* name;
+    size_t count;  // all samples since the start or Clear()
+    double p50;
+    double p95;
+    double p99;
+    double max;
+};
+
+// Collects timings of scopes.
+// Each stage keeps a rolling window of durations for percentiles,
+// and all stages share a ring buffer of events for the trace.
+class Profiler {
+ private:
+    struct Stage {
+        const char* name;
+        std::vector<double> samples;  // ring buffer of durations
+        size_t count;
+    };
+
+    struct TraceEvent {
+        int stage;
+        int thread;
+        double start;  // seconds from m_origin
+        double duration;
+    };
+
+    std::mutex m_mutex;
+    std::vector<Stage> m_stages;
+    std::vector<TraceEvent> m_events;
+    size_t m_event_count;  // recorded events, including overwritten ones
+    std::vector<std::thread::id> m_threads;  // index is the tid of the trace
+    double m_origin;
+
+    Profiler();
+
+ public:
+    static const size_t WINDOW_SIZE = 256;
+    static const size_t MAX_TRACE_EVENTS = 1 << 16;
+
+    static Profiler& Get();
+
+    // Seconds from a monotonic clock
+    static double Now();
+
+    // Id of a stage. Stages with the same name share the id.
+    // name should be a string literal, as the profiler keeps the pointer.
+    int StageId(const char* name);
+
+    void Record(int stage, double start, double end);
+
+    // Stats of stages that have samples, in the order of registration
+    void GetStats(std::vector<StageStats>* stats);
+
+    // Stats as lines of text, e.g. for an overlay
+    std::string FormatStats();
+
+    // Write recorded events as Chrome trace event JSON,
+    // which chrome://tracing and Perfetto can open.
+    bool WriteTrace(const char* path);
+
+    // Forget samples and events
+    void Clear();
+};
+
+class ProfileScope {
+ private:
+    int m_stage;
+    double m_start;
+
+ public:
+    explicit ProfileScope(int stage) : m_stage(stage), m_start(Profiler::Now()) {}
+
+    ~ProfileScope()
+    {
+        Profiler::Get().Record(m_stage, m_start, Profiler::Now());
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+}  // namespace rubiks
@@ -0,0 +1,130 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+#if defined(_MSC_VER) && !defined(__clang__) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+namespace rubiks {
+
+// A graph of states to search with breadth-first search.
+// The move set has to contain the inverse of every move.
+class StateSpace {
+ public:
+    virtual ~StateSpace() {}
+    virtual uint64_t Size() const = 0;
+    virtual int MoveNum() const = 0;
+
+    // Write the indices of the states reached by each move to neighbors.
+    virtual void Neighbors(uint64_t index, uint64_t* neighbors) const = 0;
+};
+
+// States made of two coordinates that have their own move tables.
+// A state is indexed as b * size_a + a.
+// move_a[a * move_num + m] is the new coordinate a after move m. The same goes for move_b.
+class CoordPairSpace : public StateSpace {
+ private:
+    const uint16_t* m_move_a;
+    const uint16_t* m_move_b;
+    uint64_t m_size_a;
+    uint64_t m_size_b;
+    int m_move_num;
+
+ public:
+    CoordPairSpace(const uint16_t* move_a, int size_a,
+                   const uint16_t* move_b, int size_b, int move_num)
+        : m_move_a(move_a), m_move_b(move_b),
+          m_size_a(uint64_t(size_a)), m_size_b(uint64_t(size_b)),
+          m_move_num(move_num) {}
+
+    uint64_t Size() const
+    {
+        return m_size_a * m_size_b;
+    }
+
+    int MoveNum() const
+    {
+        return m_move_num;
+    }
+
+    void Neighbors(uint64_t index, uint64_t* neighbors) const
+    {
+        const uint16_t* move_a = m_move_a + (index % m_size_a) * m_move_num;
+        const uint16_t* move_b = m_move_b + (index / m_size_a) * m_move_num;
+        for (int m = 0; m < m_move_num; m++)
+            neighbors[m] = uint64_t(move_b[m]) * m_size_a + move_a[m];
+    }
+};
+
+// Called after each depth of breadth-first search.
+// visited is the number of states found so far.
+typedef std::function<void(int depth, uint64_t visited, uint64_t size)> GenerateProgress;
+
+// Distances from the goal state, packed into 4 bits per entry.
+// Entries are owned by the table, or attached from memory such as a mapped file.
+class PruningTable {
+ private:
+    std::vector<uint8_t> m_data;
+    const uint8_t* m_view;  // entries to read
+    uint64_t m_size;
+
+ public:
+    static const int UNKNOWN = 15;  // the entry has not been visited yet
+
+    PruningTable() : m_view(nullptr), m_size(0) {}
+    PruningTable(const PruningTable&) = delete;
+    PruningTable& operator=(const PruningTable&) = delete;
+
+    // Allocate entries and mark all of them as unknown.
+    void Allocate(uint64_t size);
+
+    // Read entries from external memory. It should outlive the table.
+    void Attach(const uint8_t* data, uint64_t size);
+
+    uint64_t Size() const
+    {
+        return m_size;
+    }
+
+    size_t ByteSize() const
+    {
+        return size_t((m_size + 1) / 2);
+    }
+
+    const uint8_t* Data() const
+    {
+        return m_view;
+    }
+
+    int Get(uint64_t index) const
+    {
+        return (m_view[index >> 1] >> ((index & 1) << 2)) & 15;
+    }
+
+    // Start loading the cache line of an entry so that a later Get() doesn't wait for memory.
+    void Prefetch(uint64_t index) const
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(m_view + (index >> 1));
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        _mm_prefetch(reinterpret_cast<const char*>(m_view + (index >> 1)), _MM_HINT_T0);
+#else
+        (void)index;
+#endif
+    }
+
+    // Fill the table with distances from the goal state.
+    // It returns the largest distance.
+    // States are split into chunks for thread_num threads (0 for all cores).
+    // The result is the same for any number of threads.
+    // When *cancel becomes true, it stops after the running chunks,
+    // leaves the table empty and returns -1.
+    int Generate(const StateSpace& space, uint64_t goal, int thread_num = 0,
+                 const GenerateProgress& progress = GenerateProgress(),
+                 const std::atomic<bool>* cancel = nullptr);
+};
+
+}  // namespace rubiks
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+#include "geometry.hpp"
+
+namespace rubiks {
+
+// Destination of projected frames.
+// The libui window and the offscreen software renderer implement it.
+class RenderBackend {
+ public:
+    virtual ~RenderBackend() {}
+
+    // Fill the background, then draw visible faces in order.
+    // Later faces cover earlier ones.
+    virtual void DrawFrame(const FrameContext& frame, uint32_t background) = 0;
+};
+
+}  // namespace rubiks
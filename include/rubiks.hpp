@@ -1,7 +1,10 @@
 #pragma once
-#include <array>
-#include <queue>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include "depth_sorter.hpp"
 #include "geometry.hpp"
+#include "profiler.hpp"
 
 namespace rubiks{
 
@@ -25,12 +28,6 @@ struct Cube : QuadModel {
         AddFace({ 0, 3, 7, 4 });  // Y+
         AddFace({ 1, 5, 6, 2 });  // Y-
     }
-
-    void SetColors(std::array<uint32_t, 6> colors)
-    {
-        for (int i = 0; i < 6; i++)
-            faces[i].color = colors[i];
-    }
 };
 
 enum CubeFaceIndices : int {
@@ -53,14 +50,21 @@ enum Colors : uint32_t {
     COLOR_ORANGE = 0xDD9933
 };
 
+// Colors of faces in the solved state (in the order of CubeFaceIndices)
+const uint32_t FACE_COLORS[6] = {
+    COLOR_GREEN, COLOR_RED, COLOR_BLUE,
+    COLOR_ORANGE, COLOR_YELLOW, COLOR_WHITE
+};
+
 // This comes from Go's math.Pi, which in turn comes from http://oeis.org/A000796.
 const double RUBIKS_PI = 3.14159265358979323846264338327950288419716939937510582097494459;
 
 // Constans for game settings
-const int CUBE_NUM = 3;
-const double CUBE_DISTANCE = 180.0 / double(CUBE_NUM);
-const double CUBE_SCALE = CUBE_DISTANCE * 0.45;
-const double RUBIKS_SIZE = CUBE_DISTANCE * CUBE_NUM * 0.5;
+const int DEFAULT_CUBE_NUM = 3;
+const int MIN_CUBE_NUM = 2;
+const int MAX_CUBE_NUM = 64;
+const double RUBIKS_WIDTH = 180.0;  // side length of the whole rubiks cube
+const double VIEW_SIZE = 360.0;  // projected cubes fit in a square of this size
 const double DRAG_THRESHOLD = 12.0;
 const double ROTATION_SPEED = RUBIKS_PI / 360;
 const double GROBAL_ROTATION_SPEED = RUBIKS_PI / 360;
@@ -79,82 +83,356 @@ enum RotaionType : int {
     DEGREE_270
 };
 
-double Sign(double x)
+// Where each face moves by a 90 degree rotation around an axis.
+// e.g. ROTATED_FACES[AXIS_X - 1][FACE_Y_PLUS] == FACE_Z_PLUS
+const int ROTATED_FACES[3][6] = {
+    { FACE_Y_PLUS, FACE_X_PLUS, FACE_Y_MINUS, FACE_X_MINUS, FACE_Z_PLUS, FACE_Z_MINUS },
+    { FACE_X_MINUS, FACE_Z_MINUS, FACE_X_PLUS, FACE_Z_PLUS, FACE_Y_PLUS, FACE_Y_MINUS },
+    { FACE_Z_MINUS, FACE_Y_PLUS, FACE_Z_PLUS, FACE_Y_MINUS, FACE_X_MINUS, FACE_X_PLUS }
+};
+
+inline double Sign(double x)
 {
     return (x > 0) - (x < 0);
 }
 
-void CubeIdToXYZ(int id, int *x, int *y, int *z, int basis)
+inline int FaceAxis(int face)
 {
-    *x = id % CUBE_NUM + basis;
-    *y = (id / CUBE_NUM) % CUBE_NUM + basis;
-    *z = id / (CUBE_NUM * CUBE_NUM) + basis;
+    if (face == FACE_X_PLUS || face == FACE_X_MINUS)
+        return AXIS_X;
+    if (face == FACE_Y_PLUS || face == FACE_Y_MINUS)
+        return AXIS_Y;
+    return AXIS_Z;
 }
 
+// Get (u, v) from cube coordinates.
+// (u, v) is (y, z) for AXIS_X, (z, x) for AXIS_Y, and (x, y) for AXIS_Z.
+// Then, a 90 degree rotation around the axis always moves (u, v) to (N - 1 - v, u).
+inline void XYZToLayerUV(int axis, int x, int y, int z, int *u, int *v)
+{
+    if (axis == AXIS_X) {
+        *u = y;
+        *v = z;
+    } else if (axis == AXIS_Y) {
+        *u = z;
+        *v = x;
+    } else {
+        *u = x;
+        *v = y;
+    }
+}
+
+inline void LayerUVToXYZ(int axis, int layer, int u, int v, int *x, int *y, int *z)
+{
+    if (axis == AXIS_X) {
+        *x = layer;
+        *y = u;
+        *z = v;
+    } else if (axis == AXIS_Y) {
+        *x = v;
+        *y = layer;
+        *z = u;
+    } else {
+        *x = u;
+        *y = v;
+        *z = layer;
+    }
+}
+
+// Index of a sticker in the facelet array, or -1 for inner faces.
+// Facelets are stored face by face, and row by row in (u, v) order.
+inline int FaceletIndex(int cube_num, int face, int x, int y, int z)
+{
+    int last = cube_num - 1;
+    bool on_surface =
+        (face == FACE_X_PLUS && x == last) || (face == FACE_X_MINUS && x == 0) ||
+        (face == FACE_Y_PLUS && y == last) || (face == FACE_Y_MINUS && y == 0) ||
+        (face == FACE_Z_PLUS && z == last) || (face == FACE_Z_MINUS && z == 0);
+    if (!on_surface)
+        return -1;
+    int u, v;
+    XYZToLayerUV(FaceAxis(face), x, y, z, &u, &v);
+    return (face * cube_num + u) * cube_num + v;
+}
+
+// Facelet permutations for every layer rotation of a cube size.
+// A move (axis, layer, degree) sets facelets[targets[i]] to
+// the old value of facelets[sources[i]] for i in [offsets[move], offsets[move + 1]).
+struct FaceletMoveTable {
+    int cube_num;
+    std::vector<int> offsets;
+    std::vector<int> targets;
+    std::vector<int> sources;
+    int max_move_size;  // the largest number of facelets a move changes
+
+    FaceletMoveTable() : cube_num(0), max_move_size(0) {}
+
+    int MoveIndex(int axis, int layer, int degree) const
+    {
+        return ((axis - 1) * cube_num + layer) * 3 + degree - 1;
+    }
+
+    int MoveNum() const
+    {
+        return cube_num * 9;
+    }
+
+    void Build(int num)
+    {
+        cube_num = num;
+        offsets.clear();
+        targets.clear();
+        sources.clear();
+        max_move_size = 0;
+        for (int axis = AXIS_X; axis <= AXIS_Z; axis++) {
+            const int* rotated_faces = ROTATED_FACES[axis - 1];
+            for (int layer = 0; layer < cube_num; layer++) {
+                for (int degree = DEGREE_90; degree <= DEGREE_270; degree++) {
+                    offsets.push_back(int(targets.size()));
+                    for (int u = 0; u < cube_num; u++) {
+                        for (int v = 0; v < cube_num; v++) {
+                            // Rotate the cube and its faces
+                            int new_u = u;
+                            int new_v = v;
+                            int new_faces[6] = { 0, 1, 2, 3, 4, 5 };
+                            for (int i = 0; i < degree; i++) {
+                                int tmp = new_u;
+                                new_u = cube_num - 1 - new_v;
+                                new_v = tmp;
+                                for (int f = 0; f < 6; f++)
+                                    new_faces[f] = rotated_faces[new_faces[f]];
+                            }
+                            int x, y, z, new_x, new_y, new_z;
+                            LayerUVToXYZ(axis, layer, u, v, &x, &y, &z);
+                            LayerUVToXYZ(axis, layer, new_u, new_v, &new_x, &new_y, &new_z);
+                            for (int f = 0; f < 6; f++) {
+                                int source = FaceletIndex(cube_num, f, x, y, z);
+                                if (source < 0)
+                                    continue;
+                                sources.push_back(source);
+                                targets.push_back(FaceletIndex(cube_num, new_faces[f],
+                                                               new_x, new_y, new_z));
+                            }
+                        }
+                    }
+                    int move_size = int(targets.size()) - offsets.back();
+                    max_move_size = std::max(max_move_size, move_size);
+                }
+            }
+        }
+        offsets.push_back(int(targets.size()));
+    }
+
+    // Apply a move to facelets.
+    // work should have max_move_size elements.
+    void Apply(int move, uint8_t* facelets, uint8_t* work) const
+    {
+        const int* src = sources.data() + offsets[move];
+        const int* dst = targets.data() + offsets[move];
+        int size = offsets[move + 1] - offsets[move];
+        for (int i = 0; i < size; i++)
+            work[i] = facelets[src[i]];
+        for (int i = 0; i < size; i++)
+            facelets[dst[i]] = work[i];
+    }
+};
+
+// Projected cubes kept between frames.
+// Projected vertices of cube i stay in projected_vertices[i * 8...] of the frame,
+// and visible_masks[i] has its visible faces.
+// A cube is projected again when its stamp is older than the current one,
+// so a view change invalidates all cubes at once.
+struct ProjectionCache {
+    std::vector<uint32_t> stamps;
+    std::vector<uint8_t> visible_masks;
+    uint32_t stamp;
+
+    // Boxes for inner cubes change with the view and the turning layer
+    std::vector<uint8_t> core_masks;
+    int core_num;
+    uint32_t core_stamp;
+    int core_axis;
+    int core_layer;
+
+    bool frame_valid;  // the frame has the current state
+    bool frame_sorted;
+
+    ProjectionCache() : stamp(1), core_num(0), core_stamp(0), core_axis(0), core_layer(0),
+                        frame_valid(false), frame_sorted(false) {}
+
+    void Resize(size_t cube_count, size_t max_core_num)
+    {
+        stamps.assign(cube_count, 0);
+        visible_masks.assign(cube_count, 0);
+        core_masks.assign(max_core_num, 0);
+        InvalidateAll();
+    }
+
+    bool IsValid(int id) const
+    {
+        return stamps[id] == stamp;
+    }
+
+    void Validate(int id, uint32_t visible_mask)
+    {
+        stamps[id] = stamp;
+        visible_masks[id] = uint8_t(visible_mask);
+    }
+
+    void Invalidate(int id)
+    {
+        stamps[id] = 0;
+        frame_valid = false;
+    }
+
+    void InvalidateAll()
+    {
+        stamp++;
+        if (stamp == 0) {
+            // Wrapped around. Old stamps might match again.
+            std::fill(stamps.begin(), stamps.end(), 0);
+            stamp = 1;
+        }
+        core_stamp = 0;
+        frame_valid = false;
+    }
+
+    // Only colors changed. Faces are copied again but not projected.
+    void InvalidateFrame()
+    {
+        frame_valid = false;
+    }
+
+    bool AreCoresValid(int axis, int layer) const
+    {
+        return core_stamp == stamp && core_axis == axis && core_layer == layer;
+    }
+};
+
 struct RubiksCube {
     std::vector<Cube> cubes;
     Matrix3D global_rotation;
     Vec3D global_translation;
+    FrameContext frame;  // reusable buffers for Project()
+    DepthSorter sorter;  // keeps the face order between frames
+    ProjectionCache cache;  // projected cubes of the last frames
 
+    int cube_num;  // number of cubes on an edge (N of NxN)
+    double cube_distance;  // distance between neighboring cubes
+    double cube_scale;
+    double rubiks_size;  // half of the side length
 
-    RubiksCube() = default;
+    // Stickers of the cube. Each element is the CubeFaceIndices of its color.
+    std::vector<uint8_t> facelets;
+    FaceletMoveTable move_table;
+    std::vector<uint8_t> move_work;  // work space for RotateColors
 
-    void Initialize()
+    // The layer RotateFace is turning, or AXIS_NONE
+    int rotating_axis;
+    int rotating_layer;
+
+    // Model of black boxes drawn in place of culled inner cubes.
+    // They hide the far side of the cube through gaps between cubes.
+    Cube core;
+    int max_core_num;
+
+    RubiksCube() : cube_num(0), rotating_axis(AXIS_NONE), rotating_layer(0), max_core_num(0) {}
+
+    void Initialize(int num = DEFAULT_CUBE_NUM)
     {
-        cubes.resize(CUBE_NUM * CUBE_NUM * CUBE_NUM);
-        for (int i = 0; i < CUBE_NUM * CUBE_NUM * CUBE_NUM; i++) {
-            int x, y, z;
-            CubeIdToXYZ(i, &x, &y, &z, -1);
-            Cube& c = cubes[i];
+        cube_num = num;
+        cube_distance = RUBIKS_WIDTH / double(cube_num);
+        cube_scale = cube_distance * 0.45;
+        rubiks_size = cube_distance * cube_num * 0.5;
+
+        cubes.clear();
+        cubes.resize(cube_num * cube_num * cube_num);
+        for (Cube& c : cubes) {
             c.Initialize();
-            c.rotation = geometry::Identity();
-            c.translation = Vec3D(x, y, z) * CUBE_DISTANCE;
-            c.scale = CUBE_SCALE;
+            c.scale = cube_scale;
         }
+        facelets.resize(6 * cube_num * cube_num);
+        move_table.Build(cube_num);
+        move_work.resize(move_table.max_move_size);
+
+        core = Cube();
+        core.Initialize();
+        core.scale = 1.0;
+        // See ProjectCores() for the number of boxes
+        max_core_num = (cube_num > 2) ? (cube_num - 2) * (cube_num - 2) * 2 : 0;
 
+        // Allocate frame buffers once for all vertices and faces
+        frame.Resize((cubes.size() + max_core_num) * 8, (cubes.size() + max_core_num) * 6);
+        cache.Resize(cubes.size(), max_core_num);
+
+        InitializeFaceRotation();
         InitializeColors();
         InitializeGlobalRotation();
-        global_translation = Vec3D(180.0, 180.0, RUBIKS_SIZE * 2);
+        global_translation = Vec3D(VIEW_SIZE * 0.5, VIEW_SIZE * 0.5, rubiks_size * 2);
+    }
+
+    int CubeId(int x, int y, int z) const
+    {
+        return x + y * cube_num + z * cube_num * cube_num;
+    }
+
+    void CubeIdToXYZ(int id, int *x, int *y, int *z) const
+    {
+        *x = id % cube_num;
+        *y = (id / cube_num) % cube_num;
+        *z = id / (cube_num * cube_num);
+    }
+
+    // Position of a cube relative to the center of rubiks cube.
+    // The unit is cube_distance.
+    Vec3D CubePosition(int x, int y, int z) const
+    {
+        double center = (cube_num - 1) * 0.5;
+        return Vec3D(x - center, y - center, z - center);
     }
 
     void InitializeColors()
     {
-        for (int i = 0; i < CUBE_NUM * CUBE_NUM * CUBE_NUM; i++) {
-            std::array<uint32_t, 6> colors = {
-                COLOR_GREEN, COLOR_RED, COLOR_BLUE,
-                COLOR_ORANGE, COLOR_YELLOW, COLOR_WHITE };
-            int x, y, z;
-            CubeIdToXYZ(i, &x, &y, &z, -1);
-            if (z != -1)
-                colors[FACE_Z_MINUS] = COLOR_BLACK;
-            if (x != 1)
-                colors[FACE_X_PLUS] = COLOR_BLACK;
-            if (z != 1)
-                colors[FACE_Z_PLUS] = COLOR_BLACK;
-            if (x != -1)
-                colors[FACE_X_MINUS] = COLOR_BLACK;
-            if (y != 1)
-                colors[FACE_Y_PLUS] = COLOR_BLACK;
-            if (y != -1)
-                colors[FACE_Y_MINUS] = COLOR_BLACK;
-            cubes[i].SetColors(colors);
+        int face_size = cube_num * cube_num;
+        for (int i = 0; i < int(facelets.size()); i++)
+            facelets[i] = uint8_t(i / face_size);
+        cache.InvalidateFrame();
+    }
+
+    // Call it after writing facelets directly
+    void InvalidateColors()
+    {
+        cache.InvalidateFrame();
+    }
+
+    // Get colors of the 6 faces of a cube
+    void GetCubeColors(int id, uint32_t* colors) const
+    {
+        int x, y, z;
+        CubeIdToXYZ(id, &x, &y, &z);
+        for (int f = 0; f < 6; f++) {
+            int facelet = FaceletIndex(cube_num, f, x, y, z);
+            colors[f] = (facelet < 0) ? uint32_t(COLOR_BLACK) : FACE_COLORS[facelets[facelet]];
         }
     }
 
     void InitializeGlobalRotation()
     {
         global_rotation = geometry::RotationX(RUBIKS_PI / 6.0) * geometry::RotationY(RUBIKS_PI / 4.0);
+        cache.InvalidateAll();
     }
 
     void InitializeFaceRotation()
     {
-        for (int i = 0; i < CUBE_NUM * CUBE_NUM * CUBE_NUM; i++) {
+        rotating_axis = AXIS_NONE;
+        for (int i = 0; i < int(cubes.size()); i++) {
             int x, y, z;
-            CubeIdToXYZ(i, &x, &y, &z, -1);
+            CubeIdToXYZ(i, &x, &y, &z);
             Cube &c = cubes[i];
             c.rotation = geometry::Identity();
-            c.translation = Vec3D(x, y, z) * CUBE_DISTANCE;
+            c.translation = CubePosition(x, y, z) * cube_distance;
         }
+        cache.InvalidateAll();
     }
 
     void GlobalRotate(Vec3D rotation)
@@ -162,173 +440,310 @@ struct RubiksCube {
         rotation *= ROTATION_SPEED;
         global_rotation = geometry::RotationX(rotation.y) * global_rotation;
         global_rotation = geometry::RotationY(-rotation.x) * global_rotation;
+        cache.InvalidateAll();
     }
 
-    void Project(std::vector<Vec3D>& projected_vertices, std::vector<Quad>& visible_faces)
+    // Bit i is set when faces with the CubeFaceIndices i can face the camera
+    // for cubes with the rotation.
+    uint32_t FacingFaces(const Matrix3D& rotation) const
     {
-        // Project cubes to screen
-        for (Cube& c : cubes) {
-            c.Project(global_rotation, global_translation,
-                      projected_vertices, visible_faces);
+        Matrix3D m = global_rotation * rotation;
+        // z elements of face normals in view space. The camera looks toward +z.
+        const double normal_z[6] = { -m.m33, m.m31, m.m33, -m.m31, m.m32, -m.m32 };
+        uint32_t mask = 0;
+        for (int f = 0; f < 6; f++) {
+            // A small margin for edge-on faces. The back-face test removes them.
+            if (normal_z[f] < 1e-9)
+                mask |= 1u << f;
         }
+        return mask;
+    }
 
-        // Sort faces by depth in ascending order
-        geometry::Zsort(visible_faces);
+    // True if cubes of the layer can be seen from outside.
+    // Inner faces of the layers next to a turning layer are exposed.
+    bool IsLayerExposed(int axis, int layer) const
+    {
+        return rotating_axis == axis && std::abs(layer - rotating_layer) <= 1;
     }
-    
-    void RotateFace(int x, int y , int z, int axis, double theta)
+
+    bool IsTurningCube(int x, int y, int z) const
     {
-        if (axis == AXIS_X) {
-            for (int y = 0; y < CUBE_NUM; y ++) {
-                for (int z = 0; z < CUBE_NUM; z ++) {
-                    Cube& cube = cubes[x + y * CUBE_NUM + z * CUBE_NUM * CUBE_NUM];
-                    Matrix3D rotation = geometry::RotationX(theta);
-                    Vec3D translation = rotation * Vec3D(0, y - 1, z - 1) + Vec3D(x - 1, 0, 0);
-                    cube.rotation = rotation;
-                    cube.translation = translation * CUBE_DISTANCE;
-                }
-            }
-        } else if (axis == AXIS_Y) {
-            for (int x = 0; x < CUBE_NUM; x ++) {
-                for (int z = 0; z < CUBE_NUM; z ++) {
-                    Cube& cube = cubes[x + y * CUBE_NUM + z * CUBE_NUM * CUBE_NUM];
-                    Matrix3D rotation = geometry::RotationY(theta);
-                    Vec3D translation = rotation * Vec3D(x - 1, 0, z - 1) + Vec3D(0, y - 1, 0);
-                    cube.rotation = rotation;
-                    cube.translation = translation * CUBE_DISTANCE;
-                }
-            }
-        } else {
-            for (int x = 0; x < CUBE_NUM; x ++) {
-                for (int y = 0; y < CUBE_NUM; y ++) {
-                    Cube& cube = cubes[x + y * CUBE_NUM + z * CUBE_NUM * CUBE_NUM];
-                    Matrix3D rotation = geometry::RotationZ(theta);
-                    Vec3D translation = rotation * Vec3D(x - 1, y - 1, 0) + Vec3D(0, 0, z - 1);
-                    cube.rotation = rotation;
-                    cube.translation = translation * CUBE_DISTANCE;
-                }
+        int layer = (rotating_axis == AXIS_X) ? x : (rotating_axis == AXIS_Y) ? y : z;
+        return rotating_axis != AXIS_NONE && layer == rotating_layer;
+    }
+
+    // Project a cube to screen, or copy its faces from the cache.
+    // Vertices and face ids are placed by the cube id,
+    // so they don't depend on which cubes are culled.
+    void ProjectCube(int x, int y, int z, uint32_t still_mask, uint32_t turning_mask)
+    {
+        int id = CubeId(x, y, z);
+        const Cube& c = cubes[id];
+        uint32_t colors[6];
+        GetCubeColors(id, colors);
+        if (cache.IsValid(id)) {
+            uint32_t visible_mask = cache.visible_masks[id];
+            for (size_t f = 0; f < c.faces.size(); f++) {
+                if (visible_mask & (1u << f))
+                    c.AppendFace(f, id * 8, id * 6, frame, colors);
             }
+            return;
         }
+        uint32_t visible_mask = c.Project(global_rotation, global_translation,
+                                          id * 8, id * 6, frame, colors,
+                                          IsTurningCube(x, y, z) ? turning_mask : still_mask);
+        cache.Validate(id, visible_mask);
     }
 
-    void SwapFourColors90(const std::array<int, 8> &four_colors)
+    // Project a box covering inner cubes from begin to end (inclusive) on each axis
+    void ProjectCore(int core_id, const int* begin, const int* end, uint32_t face_mask)
     {
-        uint32_t c1 = cubes[four_colors[0]].faces[four_colors[1]].color;
-        uint32_t c2 = cubes[four_colors[2]].faces[four_colors[3]].color;
-        uint32_t c3 = cubes[four_colors[4]].faces[four_colors[5]].color;
-        uint32_t c4 = cubes[four_colors[6]].faces[four_colors[7]].color;
-        cubes[four_colors[0]].faces[four_colors[1]].color = c2;
-        cubes[four_colors[2]].faces[four_colors[3]].color = c3;
-        cubes[four_colors[4]].faces[four_colors[5]].color = c4;
-        cubes[four_colors[6]].faces[four_colors[7]].color = c1;
+        double half[3];
+        for (int a = 0; a < 3; a++)
+            half[a] = (end[a] - begin[a]) * 0.5 * cube_distance + cube_scale;
+        core.rotation = { half[0], 0, 0,
+                          0, half[1], 0,
+                          0, 0, half[2] };
+        core.translation = (CubePosition(begin[0], begin[1], begin[2]) +
+                            CubePosition(end[0], end[1], end[2])) * 0.5 * cube_distance;
+        const uint32_t colors[6] = { COLOR_BLACK, COLOR_BLACK, COLOR_BLACK,
+                                     COLOR_BLACK, COLOR_BLACK, COLOR_BLACK };
+        int id = int(cubes.size()) + core_id;
+        size_t first_face = frame.visible_face_count;
+        cache.core_masks[core_id] = uint8_t(core.Project(global_rotation, global_translation,
+                                                         id * 8, id * 6, frame, colors,
+                                                         face_mask));
+        MoveCoreBehind(first_face);
     }
 
-    void SwapFourColors180(const std::array<int, 8> &four_colors)
+    // Move faces of boxes behind every cube for the painter's algorithm.
+    // Cube faces overlapping them are in front of them or black inner faces,
+    // so the image is the same as drawing the culled cubes.
+    void MoveCoreBehind(size_t first_face)
     {
-        uint32_t c1 = cubes[four_colors[0]].faces[four_colors[1]].color;
-        uint32_t c2 = cubes[four_colors[2]].faces[four_colors[3]].color;
-        uint32_t c3 = cubes[four_colors[4]].faces[four_colors[5]].color;
-        uint32_t c4 = cubes[four_colors[6]].faces[four_colors[7]].color;
-        cubes[four_colors[0]].faces[four_colors[1]].color = c3;
-        cubes[four_colors[2]].faces[four_colors[3]].color = c4;
-        cubes[four_colors[4]].faces[four_colors[5]].color = c1;
-        cubes[four_colors[6]].faces[four_colors[7]].color = c2;
+        for (size_t i = first_face; i < frame.visible_face_count; i++)
+            frame.visible_faces[i].z = global_translation.z + rubiks_size * 2;
     }
 
-    void SwapFourColors270(const std::array<int, 8> &four_colors)
+    void AppendCachedCores()
     {
-        uint32_t c1 = cubes[four_colors[0]].faces[four_colors[1]].color;
-        uint32_t c2 = cubes[four_colors[2]].faces[four_colors[3]].color;
-        uint32_t c3 = cubes[four_colors[4]].faces[four_colors[5]].color;
-        uint32_t c4 = cubes[four_colors[6]].faces[four_colors[7]].color;
-        cubes[four_colors[0]].faces[four_colors[1]].color = c4;
-        cubes[four_colors[2]].faces[four_colors[3]].color = c1;
-        cubes[four_colors[4]].faces[four_colors[5]].color = c2;
-        cubes[four_colors[6]].faces[four_colors[7]].color = c3;
+        const uint32_t colors[6] = { COLOR_BLACK, COLOR_BLACK, COLOR_BLACK,
+                                     COLOR_BLACK, COLOR_BLACK, COLOR_BLACK };
+        size_t first_face = frame.visible_face_count;
+        for (int core_id = 0; core_id < cache.core_num; core_id++) {
+            int id = int(cubes.size()) + core_id;
+            for (size_t f = 0; f < core.faces.size(); f++) {
+                if (cache.core_masks[core_id] & (1u << f))
+                    core.AppendFace(f, id * 8, id * 6, frame, colors);
+            }
+        }
+        MoveCoreBehind(first_face);
     }
 
-    void RotateColors(int x, int y, int z, int axis, int degree) {
-        std::queue<std::array<int, 8>> swap_queues;
-        if (axis == AXIS_X) {
-            for (int i = 0; i < CUBE_NUM; i++) {
-                swap_queues.push({
-                    x + i * CUBE_NUM * CUBE_NUM, FACE_Y_MINUS,
-                    x + i * CUBE_NUM + (CUBE_NUM - 1) * CUBE_NUM * CUBE_NUM, FACE_Z_PLUS,
-                    x + (CUBE_NUM - 1) * CUBE_NUM + (CUBE_NUM - 1 - i) * CUBE_NUM * CUBE_NUM, FACE_Y_PLUS,
-                    x + (CUBE_NUM - 1 - i) * CUBE_NUM, FACE_Z_MINUS
-                });
+    // Inner cubes on an axis, split into one or two ranges by exposed layers
+    struct CoreRanges {
+        int begin[2];
+        int end[2];
+        int range_num;
+        bool split;  // a box for each layer instead of each range
+
+        int BoxNum() const
+        {
+            int num = 0;
+            for (int r = 0; r < range_num; r++)
+                num += split ? end[r] - begin[r] + 1 : 1;
+            return num;
+        }
+
+        void GetBox(int box, int* box_begin, int* box_end) const
+        {
+            for (int r = 0; r < range_num; r++) {
+                int num = split ? end[r] - begin[r] + 1 : 1;
+                if (box < num) {
+                    *box_begin = split ? begin[r] + box : begin[r];
+                    *box_end = split ? *box_begin : end[r];
+                    return;
+                }
+                box -= num;
+            }
+        }
+    };
+
+    // Project boxes for inner cubes that are not in exposed layers.
+    // When the view is almost parallel to gaps between layers, you can see through the gaps,
+    // so boxes are split into layers on that axis.
+    // It happens on two axes at most, so there are 2 * (cube_num - 2)^2 boxes at most.
+    void ProjectCores(uint32_t face_mask)
+    {
+        if (cache.AreCoresValid(rotating_axis, rotating_layer)) {
+            AppendCachedCores();
+            return;
+        }
+        cache.core_num = 0;
+        cache.core_stamp = cache.stamp;
+        cache.core_axis = rotating_axis;
+        cache.core_layer = rotating_layer;
+
+        int last = cube_num - 1;
+        if (last < 2)
+            return;
+
+        // Rays through the cube pass two layers of surface cubes at least.
+        // Rays steeper than the gap over the length can't go through gaps.
+        const double view[3] = { global_rotation.m31, global_rotation.m32, global_rotation.m33 };
+        double gap = cube_distance - cube_scale * 2;
+        double min_ray_length = cube_distance;
+
+        CoreRanges ranges[3];
+        for (int a = 0; a < 3; a++) {
+            CoreRanges& r = ranges[a];
+            r.split = std::abs(view[a]) * min_ray_length < gap;
+            r.range_num = 0;
+            if (rotating_axis - 1 != a) {
+                r.begin[r.range_num] = 1;
+                r.end[r.range_num++] = last - 1;
+                continue;
             }
-            for (int i = 0; i < CUBE_NUM - 1; i++) {
-                swap_queues.push({
-                    x + i * CUBE_NUM * CUBE_NUM, FACE_X_PLUS,
-                    x + i * CUBE_NUM + (CUBE_NUM - 1) * CUBE_NUM * CUBE_NUM, FACE_X_PLUS,
-                    x + (CUBE_NUM - 1) * CUBE_NUM + (CUBE_NUM - 1 - i) * CUBE_NUM * CUBE_NUM, FACE_X_PLUS,
-                    x + (CUBE_NUM - 1 - i) * CUBE_NUM, FACE_X_PLUS
-                });
-                swap_queues.push({
-                    x + i * CUBE_NUM * CUBE_NUM, FACE_X_MINUS,
-                    x + i * CUBE_NUM + (CUBE_NUM - 1) * CUBE_NUM * CUBE_NUM, FACE_X_MINUS,
-                    x + (CUBE_NUM - 1) * CUBE_NUM + (CUBE_NUM - 1 - i) * CUBE_NUM * CUBE_NUM, FACE_X_MINUS,
-                    x + (CUBE_NUM - 1 - i) * CUBE_NUM, FACE_X_MINUS
-                });
+            // Inner cubes before and after the exposed layers
+            if (rotating_layer - 2 >= 1) {
+                r.begin[r.range_num] = 1;
+                r.end[r.range_num++] = rotating_layer - 2;
             }
-        } else if (axis == AXIS_Y) {
-            for (int i = 0; i < CUBE_NUM; i++) {
-                swap_queues.push({
-                    i + y * CUBE_NUM, FACE_Z_MINUS,
-                    CUBE_NUM - 1 + y * CUBE_NUM + i * CUBE_NUM * CUBE_NUM, FACE_X_PLUS,
-                    CUBE_NUM - 1 - i + y * CUBE_NUM + (CUBE_NUM - 1) * CUBE_NUM * CUBE_NUM, FACE_Z_PLUS,
-                    y * CUBE_NUM + (CUBE_NUM - 1 - i) * CUBE_NUM * CUBE_NUM, FACE_X_MINUS
-                });
+            if (rotating_layer + 2 <= last - 1) {
+                r.begin[r.range_num] = rotating_layer + 2;
+                r.end[r.range_num++] = last - 1;
             }
-            for (int i = 0; i < CUBE_NUM - 1; i++) {
-                swap_queues.push({
-                    i + y * CUBE_NUM, FACE_Y_PLUS,
-                    CUBE_NUM - 1 + y * CUBE_NUM + i * CUBE_NUM * CUBE_NUM, FACE_Y_PLUS,
-                    CUBE_NUM - 1 - i + y * CUBE_NUM + (CUBE_NUM - 1) * CUBE_NUM * CUBE_NUM, FACE_Y_PLUS,
-                    y * CUBE_NUM + (CUBE_NUM - 1 - i) * CUBE_NUM * CUBE_NUM, FACE_Y_PLUS
-                });
-                swap_queues.push({
-                    i + y * CUBE_NUM, FACE_Y_MINUS,
-                    CUBE_NUM - 1 + y * CUBE_NUM + i * CUBE_NUM * CUBE_NUM, FACE_Y_MINUS,
-                    CUBE_NUM - 1 - i + y * CUBE_NUM + (CUBE_NUM - 1) * CUBE_NUM * CUBE_NUM, FACE_Y_MINUS,
-                    y * CUBE_NUM + (CUBE_NUM - 1 - i) * CUBE_NUM * CUBE_NUM, FACE_Y_MINUS
-                });
+        }
+
+        int core_id = 0;
+        int begin[3];
+        int end[3];
+        for (int bz = 0; bz < ranges[2].BoxNum(); bz++) {
+            ranges[2].GetBox(bz, &begin[2], &end[2]);
+            for (int by = 0; by < ranges[1].BoxNum(); by++) {
+                ranges[1].GetBox(by, &begin[1], &end[1]);
+                for (int bx = 0; bx < ranges[0].BoxNum(); bx++) {
+                    ranges[0].GetBox(bx, &begin[0], &end[0]);
+                    if (core_id < max_core_num)
+                        ProjectCore(core_id++, begin, end, face_mask);
+                }
             }
-        } else if (axis == AXIS_Z) {
-            for (int i = 0; i < CUBE_NUM; i++) {
-                swap_queues.push({
-                    (CUBE_NUM - 1 - i) * CUBE_NUM + z * CUBE_NUM * CUBE_NUM, FACE_X_MINUS,
-                    CUBE_NUM - 1 - i + (CUBE_NUM - 1) * CUBE_NUM + z * CUBE_NUM * CUBE_NUM, FACE_Y_PLUS,
-                    CUBE_NUM - 1 + i * CUBE_NUM + z * CUBE_NUM * CUBE_NUM, FACE_X_PLUS,
-                    i + z * CUBE_NUM * CUBE_NUM, FACE_Y_MINUS
-                });
+        }
+        cache.core_num = core_id;
+    }
+
+    // Project cubes to screen.
+    // Faces are sorted from far to near for the painter's algorithm unless sort is false.
+    //
+    // Inner cubes are hidden behind the surface, so only the surface cubes and
+    // the cubes of exposed layers are projected, and only faces that can face the camera.
+    // Boxes are drawn in place of the other inner cubes.
+    //
+    // Only cubes that moved since the last frame are projected again.
+    // When nothing changed, it returns the last frame as is.
+    const FrameContext& Project(bool sort = true)
+    {
+        RUBIKS_PROFILE_SCOPE("Project");
+        if (cache.frame_valid) {
+            if (sort && !cache.frame_sorted) {
+                sorter.Sort(frame);
+                cache.frame_sorted = true;
             }
-            for (int i = 0; i < CUBE_NUM - 1; i++) {
-                swap_queues.push({
-                    (CUBE_NUM - 1 - i) * CUBE_NUM + z * CUBE_NUM * CUBE_NUM, FACE_Z_MINUS,
-                    CUBE_NUM - 1 - i + (CUBE_NUM - 1) * CUBE_NUM + z * CUBE_NUM * CUBE_NUM, FACE_Z_MINUS,
-                    CUBE_NUM - 1 + i * CUBE_NUM + z * CUBE_NUM * CUBE_NUM, FACE_Z_MINUS,
-                    i + z * CUBE_NUM * CUBE_NUM, FACE_Z_MINUS
-                });
-                swap_queues.push({
-                    (CUBE_NUM - 1 - i) * CUBE_NUM + z * CUBE_NUM * CUBE_NUM, FACE_Z_PLUS,
-                    CUBE_NUM - 1 - i + (CUBE_NUM - 1) * CUBE_NUM + z * CUBE_NUM * CUBE_NUM, FACE_Z_PLUS,
-                    CUBE_NUM - 1 + i * CUBE_NUM + z * CUBE_NUM * CUBE_NUM, FACE_Z_PLUS,
-                    i + z * CUBE_NUM * CUBE_NUM, FACE_Z_PLUS
-                });
+            return frame;
+        }
+
+        frame.Clear();
+        uint32_t still_mask = FacingFaces(geometry::Identity());
+        uint32_t turning_mask = still_mask;
+        if (rotating_axis != AXIS_NONE)
+            turning_mask = FacingFaces(cubes[LayerCubeId(rotating_axis, rotating_layer, 0, 0)].rotation);
+
+        {
+            // Cubes are projected in the order of ids
+            RUBIKS_PROFILE_SCOPE("Project.Cubes");
+            int last = cube_num - 1;
+            for (int z = 0; z < cube_num; z++) {
+                for (int y = 0; y < cube_num; y++) {
+                    if (y == 0 || y == last || z == 0 || z == last ||
+                        IsLayerExposed(AXIS_Y, y) || IsLayerExposed(AXIS_Z, z)) {
+                        for (int x = 0; x < cube_num; x++)
+                            ProjectCube(x, y, z, still_mask, turning_mask);
+                        continue;
+                    }
+                    // Both ends of the row, and cubes of exposed layers between them
+                    ProjectCube(0, y, z, still_mask, turning_mask);
+                    if (rotating_axis == AXIS_X) {
+                        int x_end = std::min(last - 1, rotating_layer + 1);
+                        for (int x = std::max(1, rotating_layer - 1); x <= x_end; x++)
+                            ProjectCube(x, y, z, still_mask, turning_mask);
+                    }
+                    ProjectCube(last, y, z, still_mask, turning_mask);
+                }
             }
         }
+        {
+            RUBIKS_PROFILE_SCOPE("Project.Cores");
+            ProjectCores(still_mask);
+        }
+
+        if (sort)
+            sorter.Sort(frame);
+        cache.frame_valid = true;
+        cache.frame_sorted = sort;
+        return frame;
+    }
+
+    int LayerCubeId(int axis, int layer, int u, int v) const
+    {
+        int x, y, z;
+        LayerUVToXYZ(axis, layer, u, v, &x, &y, &z);
+        return CubeId(x, y, z);
+    }
 
-        while(swap_queues.size() > 0) {
-            if (degree == DEGREE_90)
-                SwapFourColors90(swap_queues.front());
-            else if (degree == DEGREE_180)
-                SwapFourColors180(swap_queues.front());
-            else if (degree == DEGREE_270)
-                SwapFourColors270(swap_queues.front());
-            swap_queues.pop();
+    void RotateFace(int x, int y , int z, int axis, double theta)
+    {
+        Matrix3D rotation;
+        int layer;
+        if (axis == AXIS_X) {
+            rotation = geometry::RotationX(theta);
+            layer = x;
+        } else if (axis == AXIS_Y) {
+            rotation = geometry::RotationY(theta);
+            layer = y;
+        } else {
+            rotation = geometry::RotationZ(theta);
+            layer = z;
         }
+
+        for (int u = 0; u < cube_num; u++) {
+            for (int v = 0; v < cube_num; v++) {
+                int id = LayerCubeId(axis, layer, u, v);
+                int cx, cy, cz;
+                CubeIdToXYZ(id, &cx, &cy, &cz);
+                Cube& cube = cubes[id];
+                cube.rotation = rotation;
+                cube.translation = rotation * CubePosition(cx, cy, cz) * cube_distance;
+                cache.Invalidate(id);
+            }
+        }
+        rotating_axis = axis;
+        rotating_layer = layer;
+    }
+
+    void RotateColors(int x, int y, int z, int axis, int degree) {
+        int layer = x;
+        if (axis == AXIS_Y)
+            layer = y;
+        else if (axis == AXIS_Z)
+            layer = z;
+        RotateLayer(axis, layer, degree);
+    }
+
+    // Turn the stickers of a layer without animation
+    void RotateLayer(int axis, int layer, int degree) {
+        int move = move_table.MoveIndex(axis, layer, degree);
+        move_table.Apply(move, facelets.data(), move_work.data());
+        cache.InvalidateFrame();
     }
 };
 
@@ -1,7 +1,10 @@
 #pragma once
-#include <queue>
-#include <random>
+#include <algorithm>
+#include <chrono>
+#include <vector>
 #include "rubiks.hpp"
+#include "cubie.hpp"
+#include "notation.hpp"
 
 namespace rubiks {
 
@@ -13,20 +16,152 @@ struct AnimationQueue {
     int rotation_type; // enum RotationType
     double degree_start;
     double degree_end;
-    double speed;
+    double speed;  // degrees per second
+    int easing;  // enum Easing
 };
 
-// Animation handler for rubiks cube
+const double FACE_TURN_SPEED = 1500.0;  // degrees per second
+
+enum Easing : int {
+    EASING_LINEAR = 0,
+    EASING_EASE_IN_OUT,
+    EASING_EASE_OUT
+};
+
+// Map the progress of an animation (0 to 1) to the progress of the angle
+inline double Ease(int easing, double t)
+{
+    if (easing == EASING_EASE_IN_OUT)
+        return t * t * (3.0 - 2.0 * t);
+    if (easing == EASING_EASE_OUT)
+        return 1.0 - (1.0 - t) * (1.0 - t);
+    return t;
+}
+
+// Seconds from a monotonic clock.
+// Unlike the system clock, it never jumps back when the time is adjusted.
+inline double MonotonicSeconds()
+{
+    typedef std::chrono::steady_clock Clock;
+    return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+}
+
+// Make an animation queue to rotate a layer by 90, 180, or 270 degrees
+inline AnimationQueue MakeRotationQueue(int axis, int layer, int rotation_type,
+                                        double speed = FACE_TURN_SPEED,
+                                        int easing = EASING_EASE_IN_OUT)
+{
+    AnimationQueue queue;
+    queue.x = (axis == AXIS_X) ? layer : 0;
+    queue.y = (axis == AXIS_Y) ? layer : 0;
+    queue.z = (axis == AXIS_Z) ? layer : 0;
+    queue.axis = axis;
+    if (rotation_type == DEGREE_270) {
+        queue.degree_start = 360.0;
+        queue.speed = -speed;
+    } else {
+        queue.degree_start = 0.0;
+        queue.speed = speed;
+    }
+    queue.degree_end = double(rotation_type * 90);
+    queue.rotation_type = rotation_type;
+    queue.easing = easing;
+    return queue;
+}
+
+// Make animation queues from face turns of a solver
+inline void MakeFaceTurnQueues(int cube_num, const std::vector<int>& moves,
+                               std::vector<AnimationQueue>* queues)
+{
+    for (int move : moves) {
+        int axis, layer, degree;
+        FaceTurnToLayerMove(cube_num, move / 3, 0, move % 3 + 1, &axis, &layer, &degree);
+        queues->push_back(MakeRotationQueue(axis, layer, degree));
+    }
+}
+
+// Animations of moves from ParseMoves() or Scrambler.
+// Moves of several layers turn them one after another.
+inline void MakeMoveQueues(int cube_num, const std::vector<NotationMove>& moves,
+                           std::vector<AnimationQueue>* queues)
+{
+    for (const NotationMove& move : moves) {
+        if (move.turns == 0)
+            continue;
+        int face, first_depth, last_depth;
+        NotationMoveLayers(move, cube_num, &face, &first_depth, &last_depth);
+        for (int depth = first_depth; depth <= last_depth; depth++) {
+            int axis, layer, degree;
+            FaceTurnToLayerMove(cube_num, face, depth, move.turns, &axis, &layer, &degree);
+            queues->push_back(MakeRotationQueue(axis, layer, degree));
+        }
+    }
+}
+
+// Frame times of animations in seconds
+struct FrameStats {
+    size_t frames;  // drawn frames
+    size_t dropped;  // frames of the target frame rate that were skipped
+    double last;  // interval between the last two frames
+    double average;
+    double max;
+};
+
+// Animation handler for rubiks cube.
+// Angles are computed from the elapsed time of a monotonic clock,
+// so animations take the same time for any timer interval.
+// When frames come late, the animation skips ahead instead of slowing down.
 class AnimationHandler {
  private:
-    std::queue<AnimationQueue> m_animation_queues;
-    double m_degree;
+    // Queues from m_queue_head are waiting. The vector is cleared when all of them end,
+    // so pushing queues doesn't allocate once it has grown.
+    std::vector<AnimationQueue> m_animation_queues;
+    size_t m_queue_head;
     RubiksCube* m_rubiks;
     bool m_is_animating;
+    double m_start_time;  // when the current queue started
+    double m_frame_interval;  // 0 for no limit
+    double m_next_frame;  // when the next frame is due
+    double m_last_frame;  // when the last frame was drawn, or negative for none
+    double m_total_interval;
+    size_t m_interval_count;  // the first frame of each animation has no interval
+    FrameStats m_stats;
+
+    static double Duration(const AnimationQueue& queue)
+    {
+        if (queue.speed == 0)
+            return 0.0;
+        return (queue.degree_end - queue.degree_start) / queue.speed;
+    }
+
+    void CountFrame(double now)
+    {
+        if (m_last_frame >= 0) {
+            double interval = now - m_last_frame;
+            if (m_frame_interval > 0) {
+                double missed = interval / m_frame_interval - 0.5;
+                if (missed >= 1)
+                    m_stats.dropped += size_t(missed);
+            }
+            m_total_interval += interval;
+            m_interval_count++;
+            m_stats.last = interval;
+            m_stats.max = std::max(m_stats.max, interval);
+            m_stats.average = m_total_interval / double(m_interval_count);
+        }
+        m_stats.frames++;
+        m_last_frame = now;
+    }
 
  public:
+    static const int DEFAULT_TARGET_FPS = 60;
+
     AnimationHandler(RubiksCube* rubiks) :
-        m_degree(0), m_rubiks(rubiks), m_is_animating(false) {}
+        m_queue_head(0), m_rubiks(rubiks), m_is_animating(false), m_start_time(0), m_next_frame(0)
+    {
+        SetTargetFps(DEFAULT_TARGET_FPS);
+        ResetStats();
+    }
 
     bool IsAnimating()
     {
@@ -36,59 +171,96 @@ class AnimationHandler {
     void ClearAnimations()
     {
         m_is_animating = false;
-        std::queue<AnimationQueue> empty;
-        std::swap(m_animation_queues, empty);
+        m_animation_queues.clear();
+        m_queue_head = 0;
     }
 
     void Push(AnimationQueue q)
     {
-        m_animation_queues.push(q);
+        m_animation_queues.push_back(q);
+    }
+
+    // Limit frames of animations to fps. 0 draws a frame for every step.
+    // Step() should be called more often than fps.
+    void SetTargetFps(int fps)
+    {
+        m_frame_interval = (fps > 0) ? 1.0 / fps : 0.0;
+    }
+
+    const FrameStats& Stats() const
+    {
+        return m_stats;
+    }
+
+    void ResetStats()
+    {
+        m_stats = FrameStats();
+        m_last_frame = -1.0;
+        m_total_interval = 0.0;
+        m_interval_count = 0;
     }
 
     // main routine for animation.
     // the return value means if it should redraw the cube or not.
     int Step()
     {
-        if (m_animation_queues.size() == 0) return 0;
+        return Step(MonotonicSeconds());
+    }
 
-        // Get the current queue
-        AnimationQueue &queue = m_animation_queues.front();
-        int x = queue.x;
-        int y = queue.y;
-        int z = queue.z;
-        int axis = queue.axis;
-        double speed = queue.speed;
-        int rotation_type = queue.rotation_type;
+    // Step at a time in seconds
+    int Step(double now)
+    {
+        RUBIKS_PROFILE_SCOPE("Step");
+        if (m_queue_head == m_animation_queues.size()) return 0;
 
         if (!IsAnimating()) {
-            m_degree = m_animation_queues.front().degree_start;
+            m_start_time = now;
+            m_next_frame = now;
+            m_last_frame = -1.0;
             m_is_animating = true;
         }
 
-        m_degree += queue.speed;
+        // Wait for the next frame
+        if (now < m_next_frame) return 0;
+        if (m_frame_interval > 0) {
+            m_next_frame += m_frame_interval;
+            // Don't try to catch up with frames that were already missed
+            if (m_next_frame < now)
+                m_next_frame = now + m_frame_interval;
+        }
+        CountFrame(now);
+
+        // Finish queues that should have ended by now
+        while (m_queue_head < m_animation_queues.size()) {
+            AnimationQueue &queue = m_animation_queues[m_queue_head];
+            double duration = Duration(queue);
+            double elapsed = now - m_start_time;
+            if (elapsed < duration) {
+                // Rotate a face
+                double degree = queue.degree_start +
+                    (queue.degree_end - queue.degree_start) * Ease(queue.easing, elapsed / duration);
+                double th = degree * RUBIKS_PI / 180.0;
+                m_rubiks->RotateFace(queue.x, queue.y, queue.z, queue.axis, th);
+                return 1;
+            }
 
-        if ((speed > 0 && m_degree >= queue.degree_end) ||
-            (speed < 0 && m_degree <= queue.degree_end) ||
-            (speed == 0)) {
             // Move to the next queue
-            if (rotation_type != DEGREE_0)
-                m_rubiks->RotateColors(x, y, z, axis, rotation_type);
+            if (queue.rotation_type != DEGREE_0)
+                m_rubiks->RotateColors(queue.x, queue.y, queue.z, queue.axis, queue.rotation_type);
             m_rubiks->InitializeFaceRotation();
-            m_animation_queues.pop();
-            if (m_animation_queues.size() > 0)
-                m_degree = m_animation_queues.front().degree_start;
-            else
-                m_is_animating = false;
-        } else {
-            // Rotate a face
-            double th = m_degree * RUBIKS_PI / 180.0;
-            m_rubiks->RotateFace(x, y, z, axis, th);
+            m_queue_head++;
+            m_start_time += duration;
         }
-
+        m_animation_queues.clear();
+        m_queue_head = 0;
+        m_is_animating = false;
         return 1;
     }
 };
 
+// Seconds to turn a dragged layer to the nearest angle
+const double SNAP_DURATION = 0.05;
+
 enum MouseState : int {
     MOUSE_STATE_IDLE = 0,
     MOUSE_STATE_ROTATE_VIEW,
@@ -135,49 +307,52 @@ class MouseHandler {
         Matrix3D transposed = m_rubiks->global_rotation.Transpose();
         Vec3D ray_pos = transposed * (mouse_pos - m_rubiks->global_translation);
         Vec3D ray_vec = transposed * Vec3D(0, 0, 1);
+        double rubiks_size = m_rubiks->rubiks_size;
+        double cube_distance = m_rubiks->cube_distance;
+        int last = m_rubiks->cube_num - 1;
 
-        if (std::abs(ray_pos.x) > RUBIKS_SIZE) {
+        if (std::abs(ray_pos.x) > rubiks_size) {
             // Check if the X faces were clicked.
             double sign_x = Sign(ray_pos.x);
-            double t = (sign_x * RUBIKS_SIZE - ray_pos.x) / ray_vec.x;
+            double t = (sign_x * rubiks_size - ray_pos.x) / ray_vec.x;
             Vec3D intersection = ray_pos + ray_vec * t;
-            if (std::abs(intersection.y) < RUBIKS_SIZE && std::abs(intersection.z) < RUBIKS_SIZE) {
-                int x = sign_x + 1;
-                int y = int((intersection.y + RUBIKS_SIZE) / CUBE_DISTANCE);
-                int z = int((intersection.z + RUBIKS_SIZE) / CUBE_DISTANCE);
-                m_clicked_cube = x + y * CUBE_NUM + z * CUBE_NUM * CUBE_NUM;
+            if (std::abs(intersection.y) < rubiks_size && std::abs(intersection.z) < rubiks_size) {
+                int x = (sign_x > 0) ? last : 0;
+                int y = int((intersection.y + rubiks_size) / cube_distance);
+                int z = int((intersection.z + rubiks_size) / cube_distance);
+                m_clicked_cube = m_rubiks->CubeId(x, y, z);
                 m_clicked_axis = AXIS_X;
                 m_clicked_pos = intersection;
                 m_state = MOUSE_STATE_SELECE_AXIS;
                 return;
             }
         }
-        if (std::abs(ray_pos.y) > RUBIKS_SIZE) {
+        if (std::abs(ray_pos.y) > rubiks_size) {
             // Check if the Y faces were clicked.
             double sign_y = Sign(ray_pos.y);
-            double t = (sign_y * RUBIKS_SIZE - ray_pos.y) / ray_vec.y;
+            double t = (sign_y * rubiks_size - ray_pos.y) / ray_vec.y;
             Vec3D intersection = ray_pos + ray_vec * t;
-            if (std::abs(intersection.x) < RUBIKS_SIZE && std::abs(intersection.z) < RUBIKS_SIZE) {
-                int x = int((intersection.x + RUBIKS_SIZE) / CUBE_DISTANCE);
-                int y = sign_y + 1;
-                int z = int((intersection.z + RUBIKS_SIZE) / CUBE_DISTANCE);
-                m_clicked_cube = x + y * CUBE_NUM + z * CUBE_NUM * CUBE_NUM;
+            if (std::abs(intersection.x) < rubiks_size && std::abs(intersection.z) < rubiks_size) {
+                int x = int((intersection.x + rubiks_size) / cube_distance);
+                int y = (sign_y > 0) ? last : 0;
+                int z = int((intersection.z + rubiks_size) / cube_distance);
+                m_clicked_cube = m_rubiks->CubeId(x, y, z);
                 m_clicked_axis = AXIS_Y;
                 m_clicked_pos = intersection;
                 m_state = MOUSE_STATE_SELECE_AXIS;
                 return;
             }
         }
-        if (std::abs(ray_pos.z) > RUBIKS_SIZE) {
+        if (std::abs(ray_pos.z) > rubiks_size) {
             // Check if the Z faces were clicked.
             double sign_z = Sign(ray_pos.z);
-            double t = (sign_z * RUBIKS_SIZE - ray_pos.z) / ray_vec.z;
+            double t = (sign_z * rubiks_size - ray_pos.z) / ray_vec.z;
             Vec3D intersection = ray_pos + ray_vec * t;
-            if (std::abs(intersection.x) < RUBIKS_SIZE && std::abs(intersection.y) < RUBIKS_SIZE) {
-                int x = int((intersection.x + RUBIKS_SIZE) / CUBE_DISTANCE);
-                int y = int((intersection.y + RUBIKS_SIZE) / CUBE_DISTANCE);
-                int z = sign_z + 1;
-                m_clicked_cube = x + y * CUBE_NUM + z * CUBE_NUM * CUBE_NUM;
+            if (std::abs(intersection.x) < rubiks_size && std::abs(intersection.y) < rubiks_size) {
+                int x = int((intersection.x + rubiks_size) / cube_distance);
+                int y = int((intersection.y + rubiks_size) / cube_distance);
+                int z = (sign_z > 0) ? last : 0;
+                m_clicked_cube = m_rubiks->CubeId(x, y, z);
                 m_clicked_axis = AXIS_Z;
                 m_clicked_pos = intersection;
                 m_state = MOUSE_STATE_SELECE_AXIS;
@@ -193,17 +368,19 @@ class MouseHandler {
         Matrix3D transposed = m_rubiks->global_rotation.Transpose();
         Vec3D ray_pos = transposed * (mouse_pos - m_rubiks->global_translation);
         Vec3D ray_vec = transposed * Vec3D(0, 0, 1);
+        double rubiks_size = m_rubiks->rubiks_size;
 
         int x, y, z;
-        CubeIdToXYZ(m_clicked_cube, &x, &y, &z, 0);
+        m_rubiks->CubeIdToXYZ(m_clicked_cube, &x, &y, &z);
+        Vec3D pos = m_rubiks->CubePosition(x, y, z);
 
         double t;
         if (m_clicked_axis == AXIS_X)
-            t = (Sign(x - 1) * RUBIKS_SIZE - ray_pos.x) / ray_vec.x;
+            t = (Sign(pos.x) * rubiks_size - ray_pos.x) / ray_vec.x;
         else if (m_clicked_axis == AXIS_Y)
-            t = (Sign(y - 1) * RUBIKS_SIZE - ray_pos.y) / ray_vec.y;
+            t = (Sign(pos.y) * rubiks_size - ray_pos.y) / ray_vec.y;
         else
-            t = (Sign(z - 1) * RUBIKS_SIZE - ray_pos.z) / ray_vec.z;
+            t = (Sign(pos.z) * rubiks_size - ray_pos.z) / ray_vec.z;
         Vec3D intersection = ray_pos + ray_vec * t;
 
         if (m_state == MOUSE_STATE_ROTATE_FACE) {
@@ -219,7 +396,7 @@ class MouseHandler {
                 intersection.z = m_rotation_center.z;
                 m_rotation_theta = cross_prod.z;
             }
-            m_rotation_theta *= GROBAL_ROTATION_SPEED / RUBIKS_SIZE;
+            m_rotation_theta *= GROBAL_ROTATION_SPEED / rubiks_size;
             m_rubiks->RotateFace(x, y, z, m_rotation_axis, m_rotation_theta);
         } else {
             // assert(m_state == MOUSE_STATE_SELECT_FACE)
@@ -259,7 +436,7 @@ class MouseHandler {
     {
         if (m_state == MOUSE_STATE_ROTATE_FACE) {
             int x, y, z;
-            CubeIdToXYZ(m_clicked_cube, &x, &y, &z, 0);
+            m_rubiks->CubeIdToXYZ(m_clicked_cube, &x, &y, &z);
 
             // Get the nearest angle
             m_rotation_theta *= 180 / RUBIKS_PI;
@@ -286,7 +463,8 @@ class MouseHandler {
                 queue.degree_end += 360.0;
             }
             queue.rotation_type = rotation_type;
-            queue.speed = (queue.degree_end - queue.degree_start) / 5;
+            queue.speed = (queue.degree_end - queue.degree_start) / SNAP_DURATION;
+            queue.easing = EASING_EASE_OUT;  // keep the speed of the drag at first
             if (queue.speed != 0)
                 m_animation_handler->Push(queue);
         }
@@ -326,47 +504,4 @@ class MouseHandler {
     }
 };
 
-class Scrambler {
- private:
-    std::mt19937 rng;
-
- public:
-    Scrambler() {
-        std::random_device seed_gen;
-        rng = std::mt19937(seed_gen());
-    }
-
-    AnimationQueue GenerateFaceRotation() {
-        // Generate a face rotation
-        int axis = (rng() + 3) % 3 + 1;
-        int x = 0;
-        int y = 0;
-        int z = 0;
-        if (axis == AXIS_X)
-            x = rng() % CUBE_NUM;
-        else if (axis == AXIS_Y)
-            y = rng() % CUBE_NUM;
-        else if (axis == AXIS_Z)
-            z = rng() % CUBE_NUM;
-        int rotation_type = (rng() + 3) % 3 + 1;
-
-        // Add the rotation to animation queues
-        AnimationQueue queue;
-        queue.x = x;
-        queue.y = y;
-        queue.z = z;
-        queue.axis = axis;
-        if (rotation_type == DEGREE_270) {
-            queue.degree_start = 360.0;
-            queue.speed = -15.0;
-        } else {
-            queue.degree_start = 0.0;
-            queue.speed = 15.0;
-        }
-        queue.degree_end = double(rotation_type * 90);
-        queue.rotation_type = rotation_type;
-        return queue;
-    }
-};
-
 }  // namespace rubiks
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <random>
+#include <vector>
+#include "cubie.hpp"
+#include "notation.hpp"
+#include "thread_pool.hpp"
+#include "two_phase_solver.hpp"
+
+// Scrambles for the app, the command line tool and bulk generation.
+namespace rubiks {
+
+enum ScrambleType : int {
+    SCRAMBLE_RANDOM_MOVES = 0,
+    SCRAMBLE_RANDOM_STATE  // 3x3 cubes only
+};
+
+const int DEFAULT_SCRAMBLE_MOVES = 25;
+
+// Generates scrambles from a seeded std::mt19937.
+// Numbers are drawn without std::uniform_int_distribution,
+// whose results differ between standard libraries, so a seed gives
+// the same scrambles on every platform.
+//
+// Random move scrambles turn the axis of the last move again only with a later layer.
+// No moves cancel or merge (R R', R L R'), and commuting moves come in one order.
+//
+// Random state scrambles pick a solvable 3x3 state with equal probability
+// and use the inverse of its two-phase solution.
+class Scrambler {
+ private:
+    std::mt19937 m_rng;
+    int m_cube_num;
+    ScrambleType m_type;
+    int m_move_num;
+    TwoPhaseSolver m_solver;
+    std::vector<int> m_solution;
+    bool m_has_tables;
+
+    // Random number from 0 to n - 1
+    uint32_t Below(uint32_t n);
+
+ public:
+    // Random state scrambles need built tables.
+    Scrambler(int cube_num, ScrambleType type = SCRAMBLE_RANDOM_MOVES,
+              const TwoPhaseTables* tables = nullptr);
+
+    void Seed(uint32_t seed);
+
+    // Seed for the index-th scramble of a set
+    void Seed(uint32_t seed, uint64_t index);
+
+    // Number of moves of random move scrambles
+    void SetMoveNum(int move_num)
+    {
+        m_move_num = move_num;
+    }
+
+    int MoveNum() const
+    {
+        return m_move_num;
+    }
+
+    ScrambleType Type() const
+    {
+        return m_type;
+    }
+
+    // Make a scramble of the type.
+    // It returns false if a random state can't be solved in timeout seconds.
+    bool Generate(std::vector<NotationMove>* scramble, double timeout = 1.0);
+
+    void RandomMoves(std::vector<NotationMove>* scramble);
+
+    // Solvable 3x3 state. All states are equally likely.
+    CubieCube RandomCube();
+
+    bool RandomState(std::vector<NotationMove>* scramble, double timeout = 1.0);
+};
+
+// Scramble that makes the state solved by a solution from a solved cube.
+// Moves are FaceTurn() numbers.
+void InvertSolution(const std::vector<int>& solution, std::vector<NotationMove>* scramble);
+
+// Make count scrambles with copies of scrambler on the threads of pool.
+// Scramble i only depends on seed and i, so a seed gives the same scrambles
+// with any number of threads. It returns false if a scramble fails.
+bool GenerateScrambles(ThreadPool* pool, const Scrambler& scrambler, uint32_t seed,
+                       size_t count, std::vector<std::vector<NotationMove>>* scrambles);
+
+}  // namespace rubiks
@@ -0,0 +1,120 @@
+#pragma once
+#include <cstddef>
+
+// Pick the widest vector unit the compiler targets.
+// AVX2 has to be enabled by compiler flags (e.g. -mavx2 or /arch:AVX2).
+// SSE2 and NEON are always available on x86_64 and aarch64.
+#if defined(__AVX2__)
+#define RUBIKS_SIMD_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RUBIKS_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define RUBIKS_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace simd {
+
+inline const char* KernelName()
+{
+#if defined(RUBIKS_SIMD_AVX2)
+    return "avx2";
+#elif defined(RUBIKS_SIMD_SSE2)
+    return "sse2";
+#elif defined(RUBIKS_SIMD_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+// Apply an affine transform to vertices stored as separate x, y, z arrays.
+// m is a row-major 3x4 matrix (3x3 linear part and translation column).
+// Output arrays must not overlap input arrays.
+inline void TransformAffine(
+    const double* m,
+    const double* x, const double* y, const double* z,
+    double* out_x, double* out_y, double* out_z,
+    size_t n)
+{
+    size_t i = 0;
+
+#if defined(RUBIKS_SIMD_AVX2)
+    __m256d m11 = _mm256_set1_pd(m[0]), m12 = _mm256_set1_pd(m[1]);
+    __m256d m13 = _mm256_set1_pd(m[2]), m14 = _mm256_set1_pd(m[3]);
+    __m256d m21 = _mm256_set1_pd(m[4]), m22 = _mm256_set1_pd(m[5]);
+    __m256d m23 = _mm256_set1_pd(m[6]), m24 = _mm256_set1_pd(m[7]);
+    __m256d m31 = _mm256_set1_pd(m[8]), m32 = _mm256_set1_pd(m[9]);
+    __m256d m33 = _mm256_set1_pd(m[10]), m34 = _mm256_set1_pd(m[11]);
+    for (; i + 4 <= n; i += 4) {
+        __m256d vx = _mm256_loadu_pd(x + i);
+        __m256d vy = _mm256_loadu_pd(y + i);
+        __m256d vz = _mm256_loadu_pd(z + i);
+        __m256d rx = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(
+            _mm256_mul_pd(m11, vx), _mm256_mul_pd(m12, vy)), _mm256_mul_pd(m13, vz)), m14);
+        __m256d ry = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(
+            _mm256_mul_pd(m21, vx), _mm256_mul_pd(m22, vy)), _mm256_mul_pd(m23, vz)), m24);
+        __m256d rz = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(
+            _mm256_mul_pd(m31, vx), _mm256_mul_pd(m32, vy)), _mm256_mul_pd(m33, vz)), m34);
+        _mm256_storeu_pd(out_x + i, rx);
+        _mm256_storeu_pd(out_y + i, ry);
+        _mm256_storeu_pd(out_z + i, rz);
+    }
+#elif defined(RUBIKS_SIMD_SSE2)
+    __m128d m11 = _mm_set1_pd(m[0]), m12 = _mm_set1_pd(m[1]);
+    __m128d m13 = _mm_set1_pd(m[2]), m14 = _mm_set1_pd(m[3]);
+    __m128d m21 = _mm_set1_pd(m[4]), m22 = _mm_set1_pd(m[5]);
+    __m128d m23 = _mm_set1_pd(m[6]), m24 = _mm_set1_pd(m[7]);
+    __m128d m31 = _mm_set1_pd(m[8]), m32 = _mm_set1_pd(m[9]);
+    __m128d m33 = _mm_set1_pd(m[10]), m34 = _mm_set1_pd(m[11]);
+    for (; i + 2 <= n; i += 2) {
+        __m128d vx = _mm_loadu_pd(x + i);
+        __m128d vy = _mm_loadu_pd(y + i);
+        __m128d vz = _mm_loadu_pd(z + i);
+        __m128d rx = _mm_add_pd(_mm_add_pd(_mm_add_pd(
+            _mm_mul_pd(m11, vx), _mm_mul_pd(m12, vy)), _mm_mul_pd(m13, vz)), m14);
+        __m128d ry = _mm_add_pd(_mm_add_pd(_mm_add_pd(
+            _mm_mul_pd(m21, vx), _mm_mul_pd(m22, vy)), _mm_mul_pd(m23, vz)), m24);
+        __m128d rz = _mm_add_pd(_mm_add_pd(_mm_add_pd(
+            _mm_mul_pd(m31, vx), _mm_mul_pd(m32, vy)), _mm_mul_pd(m33, vz)), m34);
+        _mm_storeu_pd(out_x + i, rx);
+        _mm_storeu_pd(out_y + i, ry);
+        _mm_storeu_pd(out_z + i, rz);
+    }
+#elif defined(RUBIKS_SIMD_NEON)
+    float64x2_t m11 = vdupq_n_f64(m[0]), m12 = vdupq_n_f64(m[1]);
+    float64x2_t m13 = vdupq_n_f64(m[2]), m14 = vdupq_n_f64(m[3]);
+    float64x2_t m21 = vdupq_n_f64(m[4]), m22 = vdupq_n_f64(m[5]);
+    float64x2_t m23 = vdupq_n_f64(m[6]), m24 = vdupq_n_f64(m[7]);
+    float64x2_t m31 = vdupq_n_f64(m[8]), m32 = vdupq_n_f64(m[9]);
+    float64x2_t m33 = vdupq_n_f64(m[10]), m34 = vdupq_n_f64(m[11]);
+    for (; i + 2 <= n; i += 2) {
+        float64x2_t vx = vld1q_f64(x + i);
+        float64x2_t vy = vld1q_f64(y + i);
+        float64x2_t vz = vld1q_f64(z + i);
+        float64x2_t rx = vaddq_f64(vaddq_f64(vaddq_f64(
+            vmulq_f64(m11, vx), vmulq_f64(m12, vy)), vmulq_f64(m13, vz)), m14);
+        float64x2_t ry = vaddq_f64(vaddq_f64(vaddq_f64(
+            vmulq_f64(m21, vx), vmulq_f64(m22, vy)), vmulq_f64(m23, vz)), m24);
+        float64x2_t rz = vaddq_f64(vaddq_f64(vaddq_f64(
+            vmulq_f64(m31, vx), vmulq_f64(m32, vy)), vmulq_f64(m33, vz)), m34);
+        vst1q_f64(out_x + i, rx);
+        vst1q_f64(out_y + i, ry);
+        vst1q_f64(out_z + i, rz);
+    }
+#endif
+
+    // Scalar fallback and the remaining vertices
+    for (; i < n; i++) {
+        double vx = x[i];
+        double vy = y[i];
+        double vz = z[i];
+        out_x[i] = m[0] * vx + m[1] * vy + m[2] * vz + m[3];
+        out_y[i] = m[4] * vx + m[5] * vy + m[6] * vz + m[7];
+        out_z[i] = m[8] * vx + m[9] * vy + m[10] * vz + m[11];
+    }
+}
+
+}  // namespace simd
@@ -0,0 +1,121 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "framebuffer.hpp"
+#include "render_backend.hpp"
+#include "span_fill.hpp"
+#include "thread_pool.hpp"
+
+namespace rubiks {
+
+// CPU scanline rasterizer.
+// It scales the VIEW_SIZE square of projected coordinates to fit the framebuffer
+// and fills faces without anti-aliasing.
+//
+// The framebuffer is split into tiles, and tiles are rasterized in parallel.
+// Each tile draws the faces overlapping it in frame order,
+// so the image is the same for any number of threads.
+//
+// By default, later faces cover earlier ones, so frames should be sorted by Zsort.
+// With the depth test, each pixel keeps the nearest face instead,
+// so frames don't need sorting and intersecting layers are drawn correctly.
+class SoftwareRenderer : public RenderBackend {
+ private:
+    // Non-horizontal edge of a quad, from top to bottom
+    struct Edge {
+        double y_top;
+        double y_bottom;
+        double x_top;
+        double slope;  // dx / dy
+    };
+
+    // Face in framebuffer coordinates
+    struct ScreenQuad {
+        Edge edges[4];
+        int edge_num;
+        uint32_t pixel;
+        // Depth at (x, y) is z_base + dzdx * x + dzdy * y
+        double z_base;
+        double dzdx;
+        double dzdy;
+    };
+
+    struct Rect {
+        int left;
+        int top;
+        int right;
+        int bottom;
+    };
+
+    struct Tile {
+        Rect rect;
+        // Faces of the last frame are in this rectangle, and other pixels are the background.
+        // The next frame only clears the rectangle.
+        Rect dirty;
+        std::vector<uint32_t> faces;  // indices of m_quads overlapping the tile
+    };
+
+    Framebuffer m_framebuffer;
+    double m_scale;
+    double m_offset_x;
+    double m_offset_y;
+    simd::FillSpanFunc m_fill_span;
+    uint32_t m_background;
+    bool m_cleared;  // pixels out of dirty rectangles are m_background
+    bool m_clear_all;  // the current frame clears whole tiles
+    bool m_depth_test;
+    std::vector<float> m_depth;  // depth buffer for the depth test
+
+    std::vector<ScreenQuad> m_quads;
+    std::vector<Tile> m_tiles;
+    int m_tile_columns;
+    std::unique_ptr<ThreadPool> m_pool;
+
+    // Transform faces to framebuffer coordinates and bin them into tiles
+    void BinFaces(const FrameContext& frame);
+
+    void DrawTile(Tile& tile, uint32_t background);
+
+    // Fill the part of a convex quad in a tile.
+    // Pixels are covered when their centers are inside the quad.
+    void FillQuad(const ScreenQuad& quad, Tile& tile);
+
+    // Fill pixels of a span where the quad is nearer than the depth buffer
+    void FillSpanDepth(const ScreenQuad& quad, int x_begin, int x_end, int y);
+
+ public:
+    static const int TILE_WIDTH = 128;
+    static const int TILE_HEIGHT = 64;
+
+    // thread_num is the number of threads to rasterize tiles (0 for all cores).
+    SoftwareRenderer(int width, int height, int thread_num = 1);
+
+    void Resize(int width, int height);
+
+    // Use a specific span kernel instead of the best one, e.g. for benchmarks.
+    // It returns false if the CPU doesn't support the kernel.
+    bool SetSpanKernel(simd::SpanKernel kernel);
+
+    // Keep the nearest face for each pixel instead of the last one.
+    void SetDepthTest(bool enable);
+
+    bool DepthTest() const
+    {
+        return m_depth_test;
+    }
+
+    void DrawFrame(const FrameContext& frame, uint32_t background) override;
+
+    const Framebuffer& GetFramebuffer() const
+    {
+        return m_framebuffer;
+    }
+
+    int ThreadNum() const
+    {
+        return m_pool->ThreadNum();
+    }
+};
+
+}  // namespace rubiks
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Kernels to fill horizontal spans of 32-bit pixels.
+// Unlike TransformAffine in simd.hpp, the kernel is picked at run time,
+// so builds for baseline x86_64 still use AVX2 on CPUs that have it.
+namespace simd {
+
+enum SpanKernel : int {
+    SPAN_KERNEL_SCALAR = 0,
+    SPAN_KERNEL_SSE2,  // 4 pixels per store
+    SPAN_KERNEL_AVX2,  // 8 pixels per store
+    SPAN_KERNEL_NEON,  // 4 pixels per store
+    SPAN_KERNEL_MAX
+};
+
+typedef void (*FillSpanFunc)(uint32_t* dst, size_t n, uint32_t pixel);
+
+// It returns nullptr when the CPU or the build doesn't support the kernel.
+FillSpanFunc GetFillSpan(SpanKernel kernel);
+
+// The widest kernel this CPU supports. It's detected once.
+SpanKernel BestSpanKernel();
+
+const char* SpanKernelName(SpanKernel kernel);
+
+// Fill dst[0...n-1] with the best kernel
+void FillSpan(uint32_t* dst, size_t n, uint32_t pixel);
+
+}  // namespace simd
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include "cubie.hpp"
+
+// Symmetries of the cube at the cubie level.
+// Solvers use them to shrink pruning tables and to look at a cube along other axes.
+namespace rubiks {
+
+// Symmetry s is ROT_URF3^(s / 16) * ROT_F2^(s / 8 % 2) * ROT_U4^(s / 2 % 4) * MIRR_LR2^(s % 2).
+//   ROT_URF3  120 degree rotation around the URF-DBL diagonal (U to R, R to F, F to U)
+//   ROT_F2    180 degree rotation around the F-B axis
+//   ROT_U4    90 degree rotation around the U-D axis
+//   MIRR_LR2  reflection through the plane between L and R
+// The first UD_SYM_NUM symmetries keep the U-D axis.
+const int SYM_NUM = 48;
+const int UD_SYM_NUM = 16;
+const int SYM_URF3 = 16;
+
+// result = a * b for cubes that may be mirrored.
+// Mirrored corners have orientations 3 to 5. Only symmetry cubes are mirrored.
+inline void MultiplySymmetric(const CubieCube& a, const CubieCube& b, CubieCube* result)
+{
+    for (int i = 0; i < 8; i++) {
+        int b_perm = b.CornerPerm(i);
+        int ori_a = a.CornerOri(b_perm);
+        int ori_b = b.CornerOri(i);
+        int ori;
+        if (ori_a < 3 && ori_b < 3)
+            ori = (ori_a + ori_b) % 3;
+        else if (ori_a < 3)
+            ori = (ori_a + ori_b) % 3 + 3;  // b is mirrored
+        else if (ori_b < 3)
+            ori = (ori_a - ori_b + 3) % 3 + 3;  // a is mirrored
+        else
+            ori = (ori_a - ori_b + 3) % 3;  // both are mirrored
+        result->SetCorner(i, a.CornerPerm(b_perm), ori);
+    }
+    for (int i = 0; i < 12; i++) {
+        uint8_t be = b.edges[i];
+        uint8_t ae = a.edges[be & 15];
+        result->edges[i] = uint8_t(ae ^ (be & 16));
+    }
+}
+
+// Symmetry cubes and their effect on face turns
+struct Symmetries {
+    CubieCube cubes[SYM_NUM];
+    int inverse[SYM_NUM];
+    int moves[SYM_NUM][FACE_TURN_NUM];  // S^-1 * m * S as FaceTurn() numbers
+
+    // face_turns are the cubes of BuildFaceTurnCubes().
+    void Build(const CubieCube* face_turns);
+
+    // S^-1 * c * S, the cube c seen through symmetry s.
+    // A solution of c conjugated by s solves the result.
+    void Conjugate(const CubieCube& c, int s, CubieCube* result) const
+    {
+        CubieCube t;
+        MultiplySymmetric(cubes[inverse[s]], c, &t);
+        MultiplySymmetric(t, cubes[s], result);
+    }
+};
+
+}  // namespace rubiks
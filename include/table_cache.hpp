@@ -0,0 +1,121 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "pruning_table.hpp"
+
+// On-disk cache of pruning tables.
+// Files are mapped into memory, so processes using the same file share its pages.
+// The checksum of the tables is checked when a file is written, not when it's loaded,
+// so loading takes the same time for any table size.
+namespace rubiks {
+
+// Read-only memory mapping of a file
+class MappedFile {
+ private:
+    const uint8_t* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void* m_file;
+    void* m_mapping;
+#endif
+
+ public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // It returns false if the file can't be opened.
+    bool Open(const std::string& path);
+    void Close();
+
+    bool IsOpen() const
+    {
+        return m_data != nullptr;
+    }
+
+    const uint8_t* Data() const
+    {
+        return m_data;
+    }
+
+    size_t Size() const
+    {
+        return m_size;
+    }
+};
+
+const uint32_t TABLE_FILE_FORMAT_VERSION = 1;
+const int MAX_TABLE_FILE_TABLES = 8;
+
+// Metrics the tables are generated for
+enum MoveMetric : uint32_t {
+    METRIC_FACE_TURN = 1,  // 18 moves of 90 and 180 degrees
+};
+
+// What the tables in a file are made for.
+// A file is stale when any of them differ.
+struct TableFileInfo {
+    const char* name;  // solver name (up to 15 characters)
+    uint32_t version;  // version of the table layout
+    uint32_t cube_num;
+    uint32_t metric;
+    uint64_t move_hash;  // fingerprint of the move definitions
+    std::vector<uint64_t> table_sizes;  // number of entries of each table
+};
+
+// Header at the start of a table file.
+// Tables follow it at 64 byte aligned offsets.
+struct TableFileHeader {
+    char magic[8];
+    uint32_t format_version;
+    uint32_t byte_order;
+    char name[16];
+    uint32_t version;
+    uint32_t cube_num;
+    uint32_t metric;
+    uint32_t table_num;
+    uint64_t move_hash;
+    uint64_t table_sizes[MAX_TABLE_FILE_TABLES];
+    uint64_t table_offsets[MAX_TABLE_FILE_TABLES];
+    uint64_t checksum;  // FNV-1a of all tables
+    uint64_t header_checksum;  // FNV-1a of the fields above
+};
+
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+
+inline uint64_t Fnv1a(const void* data, size_t size, uint64_t hash = FNV_OFFSET_BASIS)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Write tables to a file.
+// It writes a temporary file first and checks its checksum,
+// so other processes never map a broken file.
+bool SaveTables(const std::string& path, const TableFileInfo& info,
+                PruningTable* const* tables);
+
+// Map a file and attach the tables to it.
+// It only reads the header, and pages of the tables are read when they are used.
+// It returns false if the file is missing, stale, or too short for its tables,
+// so callers generate the tables again.
+bool LoadTables(const std::string& path, const TableFileInfo& info,
+                MappedFile* file, PruningTable* const* tables);
+
+// Compare the tables in a mapped file with the checksum.
+// It reads the whole file (about 2.6 s for the table of OptimalSolver).
+bool VerifyTables(const MappedFile& file);
+
+// Path to a file in the cache directory of the app.
+// The directory is $RUBIKS_TABLE_DIR if set, or a "libui-rubiks-demo" directory
+// in the user's cache directory. It returns an empty string if there is no place.
+std::string TableCachePath(const char* file_name);
+
+}  // namespace rubiks
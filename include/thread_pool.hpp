@@ -0,0 +1,65 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rubiks {
+
+// Work-stealing thread pool.
+// Each worker has its own queue of tasks, and takes tasks from other queues when it runs out.
+// The calling thread works as worker 0.
+class ThreadPool {
+ public:
+    // func(task, worker) runs a task on a worker.
+    typedef std::function<void(size_t task, int worker)> TaskFunc;
+
+ private:
+    // Tasks begin to end - 1. The owner takes the front, and thieves take the back.
+    // Each worker's tasks are contiguous, so a range is enough and ParallelFor doesn't allocate.
+    struct Queue {
+        std::mutex mutex;
+        size_t begin;
+        size_t end;
+
+        Queue() : begin(0), end(0) {}
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_finish;
+    const TaskFunc* m_func;
+    uint64_t m_generation;
+    int m_active;  // workers running the current tasks
+    bool m_quit;
+
+    bool PopTask(int worker, size_t* task);
+    void RunTasks(int worker);
+    void WorkerLoop(int worker);
+
+ public:
+    // 0 for all cores
+    explicit ThreadPool(int thread_num = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int ThreadNum() const
+    {
+        return int(m_queues.size());
+    }
+
+    // Run tasks 0 to task_num - 1 and wait for all of them.
+    // Each worker starts with a contiguous block of tasks and runs them in order.
+    // With one thread, all tasks run in order on the calling thread.
+    // Only one thread can call it at a time.
+    void ParallelFor(size_t task_num, const TaskFunc& func);
+};
+
+}  // namespace rubiks
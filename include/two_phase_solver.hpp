@@ -0,0 +1,107 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "cubie.hpp"
+#include "pruning_table.hpp"
+#include "table_cache.hpp"
+
+namespace rubiks {
+
+// Moves that keep cubes in the subgroup <U, D, R2, L2, F2, B2>
+const int PHASE2_MOVE_NUM = 10;
+const int PHASE2_MOVES[PHASE2_MOVE_NUM] = {
+    FACE_U * 3, FACE_U * 3 + 1, FACE_U * 3 + 2,
+    FACE_R * 3 + 1, FACE_F * 3 + 1,
+    FACE_D * 3, FACE_D * 3 + 1, FACE_D * 3 + 2,
+    FACE_L * 3 + 1, FACE_B * 3 + 1,
+};
+
+// Move tables and pruning tables for TwoPhaseSolver.
+// They are read-only after Build(), so solvers on different threads can share them.
+struct TwoPhaseTables {
+    CubieCube moves[FACE_TURN_NUM];
+
+    // phase 1 (indexed by FaceTurn() numbers)
+    std::vector<uint16_t> twist_move;  // [CORNER_ORI_NUM][FACE_TURN_NUM]
+    std::vector<uint16_t> flip_move;  // [EDGE_ORI_NUM][FACE_TURN_NUM]
+    std::vector<uint16_t> slice_move;  // [SLICE_NUM][FACE_TURN_NUM]
+    PruningTable twist_slice_table;  // slice * CORNER_ORI_NUM + twist
+    PruningTable flip_slice_table;  // slice * EDGE_ORI_NUM + flip
+    PruningTable twist_flip_table;  // flip * CORNER_ORI_NUM + twist
+
+    // phase 2 (indexed by PHASE2_MOVES)
+    std::vector<uint16_t> corner_perm_move;  // [CORNER_PERM_NUM][PHASE2_MOVE_NUM]
+    std::vector<uint16_t> ud_edge_perm_move;  // [UD_EDGE_PERM_NUM][PHASE2_MOVE_NUM]
+    std::vector<uint16_t> slice_perm_move;  // [SLICE_PERM_NUM][PHASE2_MOVE_NUM]
+    PruningTable corner_slice_table;  // corner_perm * SLICE_PERM_NUM + slice_perm
+    PruningTable edge_slice_table;  // ud_edge_perm * SLICE_PERM_NUM + slice_perm
+
+    // Whole cube rotations that bring each axis to the U-D axis.
+    // rotation_facelets[k][i] is the facelet that moves to i,
+    // and rotation_faces[k][f] is the original face of face f after the rotation.
+    uint8_t rotation_facelets[3][54];
+    int rotation_faces[3][6];
+
+    MappedFile table_file;
+    bool built;
+
+    TwoPhaseTables() : built(false) {}
+
+    // Build all tables from the moves of FaceletMoveTable.
+    // Pruning tables are loaded from cache_path if it has tables for the current moves.
+    // Otherwise, they are generated and saved to cache_path.
+    void Build(const std::string& cache_path = "");
+};
+
+// Near-optimal solver for 3x3 cubes (Kociemba's two-phase algorithm).
+// Phase 1 brings the cube into <U, D, R2, L2, F2, B2>, and phase 2 solves it in the subgroup.
+// It searches the cube and its inverse in 3 orientations together,
+// because one of them often has a much shorter phase 1.
+// A solver is cheap to make. Use one solver per thread with shared tables.
+class TwoPhaseSolver {
+ private:
+    static const int MAX_PATH_LENGTH = 32;
+    static const int VARIANT_NUM = 6;  // 3 orientations of the cube and its inverse
+
+    const TwoPhaseTables* m_tables;
+
+    // state of the current search
+    CubieCube m_cubes[VARIANT_NUM];
+    int m_variant;
+    int m_path[MAX_PATH_LENGTH];
+    int m_phase1_length;
+    std::vector<int> m_solution;
+    int m_max_length;
+    double m_deadline;
+    bool m_found;
+    bool m_done;
+    uint64_t m_node_count;
+
+    int Phase1Heuristic(int twist, int flip, int slice, int limit) const;
+    bool Phase1(int twist, int flip, int slice, int depth, int bound, int last_face);
+    void StartPhase2(int phase1_length);
+    void SetSolution(int length);
+    bool Phase2(int corner_perm, int ud_edge_perm, int slice_perm,
+                int depth, int bound, int last_face);
+
+ public:
+    // tables should be built before solving.
+    TwoPhaseSolver(const TwoPhaseTables* tables) :
+        m_tables(tables), m_variant(0), m_phase1_length(0), m_max_length(0), m_deadline(0),
+        m_found(false), m_done(false), m_node_count(0) {}
+
+    // Find a solution with at most max_length moves. Moves are FaceTurn() numbers.
+    // It returns false if the cube is invalid or no solution is found in timeout seconds.
+    // Random states take a few milliseconds with max_length = 21.
+    bool Solve(const CubieCube& cube, std::vector<int>* solution,
+               int max_length = 21, double timeout = 1.0);
+
+    // Number of nodes visited by the last Solve() call
+    uint64_t NodeCount() const
+    {
+        return m_node_count;
+    }
+};
+
+}  // namespace rubiks
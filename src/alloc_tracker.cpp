@@ -0,0 +1,89 @@
+// Replaced operator new and delete to count heap allocations.
+// They live in their own file, so the compiler can't inline them into callers.
+#include "alloc_tracker.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> g_alloc_count(0);
+
+}  // namespace
+
+// Count heap allocations of the whole program
+void* operator new(size_t size)
+{
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size == 0 ? 1 : size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& nothrow) noexcept
+{
+    return operator new(size, nothrow);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    free(p);
+}
+
+namespace rubiks {
+
+uint64_t AllocationCount()
+{
+    return g_alloc_count.load(std::memory_order_relaxed);
+}
+
+bool AllocationBudget::Add(uint64_t count)
+{
+    m_ops++;
+    m_total += count;
+    m_max = std::max(m_max, count);
+    if (count <= m_budget)
+        return true;
+    m_over++;
+    return false;
+}
+
+std::string AllocationBudget::Format() const
+{
+    char text[160];
+    snprintf(text, sizeof(text), "%s: %.2f allocs/op, max %llu, %zu of %zu over the budget of %llu",
+             m_name, m_ops ? double(m_total) / double(m_ops) : 0.0,
+             (unsigned long long)m_max, m_over, m_ops, (unsigned long long)m_budget);
+    return text;
+}
+
+}  // namespace rubiks
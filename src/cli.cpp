@@ -0,0 +1,529 @@
+// Headless command line tool.
+// It applies move sequences to cubes and solves them without a window.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "alloc_tracker.hpp"  // AllocationCounter, AllocationBudget
+#include "rubiks.hpp"  // RubiksCube
+#include "cubie.hpp"  // CubieCube
+#include "move_program.hpp"  // MoveProgram
+#include "notation.hpp"  // ParseMoves, FormatMoves, FormatFaceTurns
+#include "optimal_solver.hpp"  // OptimalSolver
+#include "profiler.hpp"  // Profiler
+#include "scrambler.hpp"  // Scrambler, GenerateScrambles
+#include "table_cache.hpp"  // TableCachePath
+#include "two_phase_solver.hpp"  // TwoPhaseSolver
+#include "software_renderer.hpp"  // SoftwareRenderer
+
+enum SolverType {
+    SOLVER_NONE = 0,
+    SOLVER_TWO_PHASE,
+    SOLVER_OPTIMAL
+};
+
+struct Options {
+    int cube_num;
+    SolverType solver;
+    int max_length;  // 0 for the default of each solver
+    double timeout;
+    int thread_num;
+    bool use_cache;
+    const char* input;
+    const char* image;  // path of rendered images, or nullptr
+    int image_width;
+    int image_height;
+    bool depth_test;
+    const char* trace;  // path of the trace file, or nullptr
+    int alloc_budget;  // allocations allowed per move and frame, or -1 for no check
+    int scramble_count;  // scrambles to print instead of reading moves
+    rubiks::ScrambleType scramble_type;
+    int scramble_length;
+    bool seed_set;
+    uint32_t seed;
+    bool check_tables;
+};
+
+static void PrintUsage()
+{
+    fprintf(stderr,
+        "Usage: rubiks_cli [options] [file]\n"
+        "\n"
+        "Read move sequences (e.g. \"R U R' U2\") from a file or stdin, one per line.\n"
+        "Wide turns (Rw, r, 3Rw), inner layers (3R), slices (M E S) and rotations (x y z)\n"
+        "work on any cube size.\n"
+        "Each sequence is applied to a solved cube, and the result is printed as a JSON line.\n"
+        "Empty lines and lines starting with '#' are skipped.\n"
+        "\n"
+        "Options:\n"
+        "  -n, --size N          cube size (default: 3)\n"
+        "  -s, --solver NAME     none, two-phase or optimal (default: two-phase for 3x3 cubes)\n"
+        "  -l, --max-length N    maximum solution length (default: 21 for two-phase, 20 for optimal)\n"
+        "  -t, --timeout SEC     time limit of the two-phase solver for each cube (default: 1)\n"
+        "  -j, --threads N       threads of the optimal solver and the image renderer\n"
+        "                        (default: all cores)\n"
+        "      --no-cache        don't read or write table files\n"
+        "  -o, --image FILE      render each cube to FILE (.png or .ppm).\n"
+        "                        '#' in FILE is replaced with the line number.\n"
+        "      --image-size WxH  size of rendered images (default: 720x720)\n"
+        "      --depth-test      render images with a depth buffer instead of sorting faces\n"
+        "      --trace FILE      write timings of stages as Chrome trace event JSON\n"
+        "                        and print their percentiles (needs the profiler option)\n"
+        "      --alloc-budget N  fail if a move or a frame makes more than N heap allocations.\n"
+        "                        The first cube is a warm-up. (needs the alloc_tracker option)\n"
+        "      --scramble COUNT  print COUNT scrambles, one per line, instead of reading moves\n"
+        "      --scramble-type TYPE\n"
+        "                        random-state or random-moves (default: random-state for 3x3 cubes)\n"
+        "      --scramble-length N\n"
+        "                        moves of random move scrambles (default: 25)\n"
+        "      --seed N          seed of scrambles. The same seed gives the same scrambles.\n"
+        "      --check-tables    generate the optimal solver tables with 1 thread and with\n"
+        "                        -j threads, and fail if they differ\n"
+        "  -h, --help            show this message\n");
+}
+
+static double Now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static bool ParseOptions(int argc, char** argv, Options* options)
+{
+    options->cube_num = rubiks::DEFAULT_CUBE_NUM;
+    options->solver = SOLVER_TWO_PHASE;
+    options->max_length = 0;
+    options->timeout = 1.0;
+    options->thread_num = 0;
+    options->use_cache = true;
+    options->input = nullptr;
+    options->image = nullptr;
+    options->image_width = 720;
+    options->image_height = 720;
+    options->depth_test = false;
+    options->trace = nullptr;
+    options->alloc_budget = -1;
+    options->scramble_count = 0;
+    options->scramble_type = rubiks::SCRAMBLE_RANDOM_STATE;
+    options->scramble_length = rubiks::DEFAULT_SCRAMBLE_MOVES;
+    options->seed_set = false;
+    options->seed = 0;
+    options->check_tables = false;
+    bool solver_set = false;
+    bool scramble_type_set = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            return false;
+        } else if (strcmp(arg, "--no-cache") == 0) {
+            options->use_cache = false;
+            continue;
+        } else if (strcmp(arg, "--depth-test") == 0) {
+            options->depth_test = true;
+            continue;
+        } else if (strcmp(arg, "--check-tables") == 0) {
+            options->check_tables = true;
+            continue;
+        } else if (arg[0] != '-') {
+            options->input = arg;
+            continue;
+        }
+
+        if (value == nullptr) {
+            fprintf(stderr, "Error: %s needs a value.\n", arg);
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "-n") == 0 || strcmp(arg, "--size") == 0) {
+            options->cube_num = atoi(value);
+            if (options->cube_num < rubiks::MIN_CUBE_NUM || options->cube_num > rubiks::MAX_CUBE_NUM) {
+                fprintf(stderr, "Error: size should be %d to %d.\n",
+                        rubiks::MIN_CUBE_NUM, rubiks::MAX_CUBE_NUM);
+                return false;
+            }
+        } else if (strcmp(arg, "-s") == 0 || strcmp(arg, "--solver") == 0) {
+            solver_set = true;
+            if (strcmp(value, "none") == 0) {
+                options->solver = SOLVER_NONE;
+            } else if (strcmp(value, "two-phase") == 0) {
+                options->solver = SOLVER_TWO_PHASE;
+            } else if (strcmp(value, "optimal") == 0) {
+                options->solver = SOLVER_OPTIMAL;
+            } else {
+                fprintf(stderr, "Error: unknown solver '%s'.\n", value);
+                return false;
+            }
+        } else if (strcmp(arg, "-l") == 0 || strcmp(arg, "--max-length") == 0) {
+            options->max_length = atoi(value);
+        } else if (strcmp(arg, "-t") == 0 || strcmp(arg, "--timeout") == 0) {
+            options->timeout = atof(value);
+        } else if (strcmp(arg, "-j") == 0 || strcmp(arg, "--threads") == 0) {
+            options->thread_num = atoi(value);
+        } else if (strcmp(arg, "-o") == 0 || strcmp(arg, "--image") == 0) {
+            options->image = value;
+        } else if (strcmp(arg, "--trace") == 0) {
+#ifdef RUBIKS_PROFILER
+            options->trace = value;
+#else
+            fprintf(stderr, "Error: --trace needs a build with the profiler option.\n");
+            return false;
+#endif
+        } else if (strcmp(arg, "--alloc-budget") == 0) {
+#ifdef RUBIKS_ALLOC_TRACKER
+            options->alloc_budget = atoi(value);
+            if (options->alloc_budget < 0) {
+                fprintf(stderr, "Error: invalid allocation budget '%s'.\n", value);
+                return false;
+            }
+#else
+            fprintf(stderr, "Error: --alloc-budget needs a build with the alloc_tracker option.\n");
+            return false;
+#endif
+        } else if (strcmp(arg, "--scramble") == 0) {
+            options->scramble_count = atoi(value);
+            if (options->scramble_count <= 0) {
+                fprintf(stderr, "Error: invalid scramble count '%s'.\n", value);
+                return false;
+            }
+        } else if (strcmp(arg, "--scramble-type") == 0) {
+            scramble_type_set = true;
+            if (strcmp(value, "random-state") == 0) {
+                options->scramble_type = rubiks::SCRAMBLE_RANDOM_STATE;
+            } else if (strcmp(value, "random-moves") == 0) {
+                options->scramble_type = rubiks::SCRAMBLE_RANDOM_MOVES;
+            } else {
+                fprintf(stderr, "Error: unknown scramble type '%s'.\n", value);
+                return false;
+            }
+        } else if (strcmp(arg, "--scramble-length") == 0) {
+            options->scramble_length = atoi(value);
+            if (options->scramble_length < 0) {
+                fprintf(stderr, "Error: invalid scramble length '%s'.\n", value);
+                return false;
+            }
+        } else if (strcmp(arg, "--seed") == 0) {
+            options->seed_set = true;
+            options->seed = uint32_t(strtoul(value, nullptr, 10));
+        } else if (strcmp(arg, "--image-size") == 0) {
+            if (sscanf(value, "%dx%d", &options->image_width, &options->image_height) != 2 ||
+                options->image_width <= 0 || options->image_height <= 0) {
+                fprintf(stderr, "Error: invalid image size '%s'.\n", value);
+                return false;
+            }
+        } else {
+            fprintf(stderr, "Error: unknown option '%s'.\n", arg);
+            return false;
+        }
+    }
+
+    // Solvers only support 3x3 cubes
+    if (options->cube_num != 3) {
+        if (solver_set && options->solver != SOLVER_NONE) {
+            fprintf(stderr, "Error: solvers only support 3x3 cubes.\n");
+            return false;
+        }
+        options->solver = SOLVER_NONE;
+        // Random states need the two-phase solver
+        if (scramble_type_set && options->scramble_type == rubiks::SCRAMBLE_RANDOM_STATE) {
+            fprintf(stderr, "Error: random state scrambles only support 3x3 cubes.\n");
+            return false;
+        }
+        options->scramble_type = rubiks::SCRAMBLE_RANDOM_MOVES;
+    }
+    return true;
+}
+
+static bool ReadLine(FILE* fp, std::string* line)
+{
+    line->clear();
+    int c;
+    while ((c = fgetc(fp)) != EOF) {
+        if (c == '\n')
+            return true;
+        *line += char(c);
+    }
+    return !line->empty();
+}
+
+// Stickers as face letters (URFDLB) in the order of RubiksCube::facelets
+static std::string FaceletString(const rubiks::RubiksCube& rubiks)
+{
+    char letters[6];
+    for (int f = 0; f < 6; f++)
+        letters[rubiks::NOTATION_FACES[f]] = rubiks::NOTATION_FACE_NAMES[f];
+    std::string text;
+    for (uint8_t facelet : rubiks.facelets)
+        text += letters[facelet];
+    return text;
+}
+
+static std::string JsonString(const std::string& text)
+{
+    std::string json = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            json += '\\';
+        if (c >= 0 && c < 0x20)
+            continue;
+        json += c;
+    }
+    return json + "\"";
+}
+
+#ifdef RUBIKS_ALLOC_TRACKER
+// Apply layer rotations one by one, and add allocations of each rotation to the budget if any
+static void ApplyProgramCounted(rubiks::RubiksCube* rubiks, const rubiks::MoveProgram& program,
+                                rubiks::AllocationBudget* budget)
+{
+    rubiks::AllocationCounter counter;
+    for (size_t i = 0; i < program.Code().size(); i++) {
+        counter.Restart();
+        program.Apply(rubiks, i, i + 1);
+        if (budget)
+            budget->Add(counter.Count());
+    }
+}
+#endif
+
+static std::string ImagePath(const char* pattern, int line_num)
+{
+    std::string path;
+    for (const char* c = pattern; *c; c++) {
+        if (*c == '#')
+            path += std::to_string(line_num);
+        else
+            path += *c;
+    }
+    return path;
+}
+
+// Print each depth of table generation
+static void PrintTableProgress(int table, int table_num, int depth, uint64_t visited, uint64_t size)
+{
+    fprintf(stderr, "Generating table %d of %d: depth %d, %llu of %llu states\n",
+            table + 1, table_num, depth, (unsigned long long)visited, (unsigned long long)size);
+}
+
+// Generate the tables of the optimal solver with 1 thread and with options.thread_num threads,
+// and compare them byte by byte
+static int CheckTables(const Options& options)
+{
+    rubiks::OptimalSolver serial(1);
+    rubiks::OptimalSolver parallel(options.thread_num);
+    int thread_nums[2] = { 1, parallel.ThreadNum() };
+    rubiks::OptimalSolver* solvers[2] = { &serial, &parallel };
+    for (int i = 0; i < 2; i++) {
+        double start = Now();
+        solvers[i]->Initialize("", PrintTableProgress);
+        fprintf(stderr, "Generated tables with %d threads in %.3f s.\n", thread_nums[i], Now() - start);
+    }
+
+    bool same = true;
+    for (int i = 0; i < rubiks::OptimalSolver::TABLE_NUM; i++) {
+        const rubiks::PruningTable& a = serial.Table(i);
+        const rubiks::PruningTable& b = parallel.Table(i);
+        if (a.Size() != b.Size() || memcmp(a.Data(), b.Data(), a.ByteSize()) != 0) {
+            fprintf(stderr, "Error: table %d differs between 1 and %d threads.\n",
+                    i + 1, thread_nums[1]);
+            same = false;
+        }
+    }
+    if (same)
+        fprintf(stderr, "Tables are identical.\n");
+    return same ? 0 : 1;
+}
+
+// Print scrambles made on all threads
+static int PrintScrambles(const Options& options)
+{
+    uint32_t seed = options.seed_set ? options.seed : std::random_device()();
+    rubiks::TwoPhaseTables tables;
+    if (options.scramble_type == rubiks::SCRAMBLE_RANDOM_STATE)
+        tables.Build(options.use_cache ? rubiks::TableCachePath("two_phase.tbl") : "");
+    rubiks::Scrambler scrambler(options.cube_num, options.scramble_type, &tables);
+    scrambler.SetMoveNum(options.scramble_length);
+    rubiks::ThreadPool pool(options.thread_num);
+
+    double start = Now();
+    std::vector<std::vector<rubiks::NotationMove>> scrambles;
+    bool ok = rubiks::GenerateScrambles(&pool, scrambler, seed, size_t(options.scramble_count),
+                                        &scrambles);
+    double total = Now() - start;
+    for (const std::vector<rubiks::NotationMove>& scramble : scrambles)
+        printf("%s\n", rubiks::FormatMoves(scramble).c_str());
+    fprintf(stderr, "%d scrambles with seed %u in %.3f s (%.1f scrambles/s, %d threads)\n",
+            options.scramble_count, seed, total, options.scramble_count / total, pool.ThreadNum());
+    if (!ok) {
+        fprintf(stderr, "Error: failed to solve some random states. Their lines are empty.\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, &options)) {
+        PrintUsage();
+        return 1;
+    }
+    if (options.scramble_count > 0)
+        return PrintScrambles(options);
+    if (options.check_tables)
+        return CheckTables(options);
+
+    FILE* fp = stdin;
+    if (options.input) {
+        fp = fopen(options.input, "r");
+        if (!fp) {
+            fprintf(stderr, "Error: failed to open '%s'.\n", options.input);
+            return 1;
+        }
+    }
+
+    // Prepare solver tables
+    double start = Now();
+    rubiks::TwoPhaseTables two_phase_tables;
+    // The optimal solver starts its threads only when it's used
+    rubiks::OptimalSolver optimal_solver(options.solver == SOLVER_OPTIMAL ? options.thread_num : 1);
+    if (options.solver == SOLVER_TWO_PHASE) {
+        two_phase_tables.Build(options.use_cache ? rubiks::TableCachePath("two_phase.tbl") : "");
+    } else if (options.solver == SOLVER_OPTIMAL) {
+        optimal_solver.Initialize(options.use_cache ? rubiks::TableCachePath("optimal.tbl") : "",
+                                  PrintTableProgress);
+    }
+    rubiks::TwoPhaseSolver two_phase_solver(&two_phase_tables);
+    if (options.solver != SOLVER_NONE)
+        fprintf(stderr, "Tables are ready in %.3f s.\n", Now() - start);
+
+    rubiks::RubiksCube rubiks;
+    rubiks.Initialize(options.cube_num);
+    rubiks::SoftwareRenderer renderer(options.image ? options.image_width : 0,
+                                      options.image ? options.image_height : 0,
+                                      options.image ? options.thread_num : 1);
+    renderer.SetDepthTest(options.depth_test);
+
+    std::string line;
+    std::vector<rubiks::NotationMove> moves;
+    rubiks::MoveProgram program;
+    std::vector<int> solution;
+    int line_num = 0;
+    int cube_count = 0;
+    double solve_time = 0;
+#ifdef RUBIKS_ALLOC_TRACKER
+    rubiks::AllocationBudget move_allocs("move", uint64_t(std::max(0, options.alloc_budget)));
+    rubiks::AllocationBudget frame_allocs("frame", uint64_t(std::max(0, options.alloc_budget)));
+#endif
+    start = Now();
+    while (ReadLine(fp, &line)) {
+        line_num++;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+
+        if (!rubiks::ParseMoves(line, options.cube_num, &moves)) {
+            printf("{\"line\": %d, \"error\": \"invalid moves\", \"moves\": %s}\n",
+                   line_num, JsonString(line).c_str());
+            fflush(stdout);
+            continue;
+        }
+
+        program.Reset(options.cube_num);
+        program.Append(moves);
+        rubiks.InitializeColors();
+        bool drawn = false;  // the framebuffer has the frame of this cube
+#ifdef RUBIKS_ALLOC_TRACKER
+        if (options.alloc_budget >= 0) {
+            // The first cube grows buffers, so it's not checked
+            bool warm_up = cube_count == 0;
+            ApplyProgramCounted(&rubiks, program, warm_up ? nullptr : &move_allocs);
+            rubiks::AllocationCounter counter;
+            const FrameContext& frame = rubiks.Project(!options.depth_test);
+            if (options.image) {
+                renderer.DrawFrame(frame, rubiks::COLOR_GRAY);
+                drawn = true;
+            }
+            if (!warm_up)
+                frame_allocs.Add(counter.Count());
+        } else {
+            program.Apply(&rubiks);
+        }
+#else
+        program.Apply(&rubiks);
+#endif
+        cube_count++;
+        printf("{\"line\": %d, \"moves\": %s, \"state\": \"%s\"",
+               line_num, JsonString(rubiks::FormatMoves(moves)).c_str(),
+               FaceletString(rubiks).c_str());
+
+        if (options.image) {
+            std::string path = ImagePath(options.image, line_num);
+            if (!drawn)
+                renderer.DrawFrame(rubiks.Project(!options.depth_test), rubiks::COLOR_GRAY);
+            if (renderer.GetFramebuffer().Save(path))
+                printf(", \"image\": %s", JsonString(path).c_str());
+            else
+                fprintf(stderr, "Error: failed to write '%s'.\n", path.c_str());
+        }
+
+        rubiks::CubieCube cube;
+        if (options.solver != SOLVER_NONE && !cube.FromRubiksCube(rubiks)) {
+            printf(", \"solution\": null, \"error\": \"invalid state\"");
+        } else if (options.solver != SOLVER_NONE) {
+            double t = Now();
+            bool found;
+            if (options.solver == SOLVER_TWO_PHASE) {
+                int max_length = options.max_length > 0 ? options.max_length : 21;
+                found = two_phase_solver.Solve(cube, &solution, max_length, options.timeout);
+            } else {
+                int max_length = options.max_length > 0 ? options.max_length : 20;
+                found = optimal_solver.Solve(cube, &solution, max_length);
+            }
+            t = Now() - t;
+            solve_time += t;
+            if (found) {
+                printf(", \"solution\": \"%s\", \"length\": %d",
+                       rubiks::FormatFaceTurns(solution).c_str(), int(solution.size()));
+            } else {
+                printf(", \"solution\": null");
+            }
+            printf(", \"time_ms\": %.3f", t * 1000.0);
+        }
+        printf("}\n");
+        fflush(stdout);
+    }
+    if (fp != stdin)
+        fclose(fp);
+
+    double total = Now() - start;
+    fprintf(stderr, "%d cubes in %.3f s", cube_count, total);
+    if (options.solver != SOLVER_NONE && cube_count > 0)
+        fprintf(stderr, " (%.3f ms per solve, %.1f solves/s)",
+                solve_time * 1000.0 / cube_count, cube_count / solve_time);
+    fprintf(stderr, "\n");
+
+#ifdef RUBIKS_ALLOC_TRACKER
+    if (options.alloc_budget >= 0) {
+        fprintf(stderr, "%s\n%s\n", move_allocs.Format().c_str(), frame_allocs.Format().c_str());
+        if (move_allocs.OverBudget() > 0 || frame_allocs.OverBudget() > 0) {
+            fprintf(stderr, "Error: allocations are over the budget.\n");
+            return 1;
+        }
+    }
+#endif
+
+    if (options.trace) {
+        fprintf(stderr, "%s", rubiks::Profiler::Get().FormatStats().c_str());
+        if (!rubiks::Profiler::Get().WriteTrace(options.trace)) {
+            fprintf(stderr, "Error: failed to write '%s'.\n", options.trace);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include "depth_sorter.hpp"
+#include <algorithm>
+#include "profiler.hpp"
+
+namespace rubiks {
+
+namespace {
+
+// Depths are quantized to 22 bits, which two passes of 11 bits can sort
+const int RADIX_BITS = 11;
+const uint32_t RADIX_SIZE = 1u << RADIX_BITS;
+const uint32_t MAX_KEY = (1u << (RADIX_BITS * 2)) - 1;
+
+}  // namespace
+
+bool DepthSorter::InsertionSort(std::vector<Item>& items, size_t max_shifts)
+{
+    size_t shifts = 0;
+    for (size_t i = 1; i < items.size(); i++) {
+        Item item = items[i];
+        size_t j = i;
+        for (; j > 0 && items[j - 1].z < item.z; j--)
+            items[j] = items[j - 1];
+        items[j] = item;
+        shifts += i - j;
+        if (shifts > max_shifts)
+            return false;
+    }
+    return true;
+}
+
+void DepthSorter::RadixSort(std::vector<Item>& items)
+{
+    size_t n = items.size();
+    m_radix_work.resize(n);
+
+    // Keys of farther faces are smaller
+    double z_min = items[0].z;
+    double z_max = items[0].z;
+    for (const Item& item : items) {
+        z_min = std::min(z_min, item.z);
+        z_max = std::max(z_max, item.z);
+    }
+    double scale = (z_max > z_min) ? MAX_KEY / (z_max - z_min) : 0.0;
+    for (Item& item : items)
+        item.key = uint32_t((z_max - item.z) * scale);
+
+    // LSD radix sort
+    for (int shift = 0; shift < RADIX_BITS * 2; shift += RADIX_BITS) {
+        size_t counts[RADIX_SIZE] = {};
+        for (const Item& item : items)
+            counts[(item.key >> shift) & (RADIX_SIZE - 1)]++;
+        size_t offset = 0;
+        for (uint32_t b = 0; b < RADIX_SIZE; b++) {
+            size_t c = counts[b];
+            counts[b] = offset;
+            offset += c;
+        }
+        for (const Item& item : items)
+            m_radix_work[counts[(item.key >> shift) & (RADIX_SIZE - 1)]++] = item;
+        items.swap(m_radix_work);
+    }
+    m_radix_count++;
+
+    // Faces in the same bucket can be out of order
+    InsertionSort(items, SIZE_MAX);
+}
+
+void DepthSorter::SortItems(std::vector<Item>& items)
+{
+    if (items.size() < 2)
+        return;
+    if (!InsertionSort(items, items.size() * MAX_SHIFTS_PER_FACE))
+        RadixSort(items);
+}
+
+void DepthSorter::Sort(FrameContext& frame)
+{
+    RUBIKS_PROFILE_SCOPE("Sort");
+    size_t n = frame.visible_face_count;
+    const Quad* faces = frame.visible_faces.data();
+
+    // Face ids are indices of all faces, so the frame buffers give the number of ids.
+    // A different number means a different scene.
+    if (m_by_id.size() != frame.visible_faces.size()) {
+        Reset();
+        m_by_id.assign(frame.visible_faces.size(), Item());
+        m_sorted.resize(frame.visible_faces.size());
+        m_kept.reserve(frame.visible_faces.size());
+        m_added.reserve(frame.visible_faces.size());
+    }
+
+    // Ids of visible faces are in ascending order, so this writes m_by_id sequentially.
+    for (size_t i = 0; i < n; i++)
+        m_by_id[faces[i].id] = { faces[i].z, uint32_t(i + 1), 0 };
+
+    // Faces in the last order that are still visible, then new faces.
+    // Entries are cleared on the way, so they are ready for the next frame.
+    m_kept.clear();
+    size_t unordered = 0;
+    for (int id : m_order) {
+        Item& item = m_by_id[id];
+        if (item.face) {
+            if (!m_kept.empty() && m_kept.back().z < item.z)
+                unordered++;
+            m_kept.push_back({ item.z, item.face - 1, 0 });
+            item.face = 0;
+        }
+    }
+    m_added.clear();
+    for (size_t i = 0; i < n; i++) {
+        Item& item = m_by_id[faces[i].id];
+        if (item.face) {
+            m_added.push_back({ item.z, uint32_t(i), 0 });
+            item.face = 0;
+        }
+    }
+
+    bool coherent = unordered * MIN_SORTED_RATIO < m_kept.size() &&
+                    InsertionSort(m_kept, m_kept.size() * MAX_SHIFTS_PER_FACE);
+    m_merged.resize(n);
+    if (coherent) {
+        SortItems(m_added);
+        std::merge(m_kept.begin(), m_kept.end(), m_added.begin(), m_added.end(),
+                   m_merged.begin(), [](const Item& a, const Item& b) { return a.z > b.z; });
+    } else {
+        // The last order doesn't help, so sort faces in the order of the frame.
+        for (size_t i = 0; i < n; i++)
+            m_merged[i] = { faces[i].z, uint32_t(i), 0 };
+        if (n > 1)
+            RadixSort(m_merged);
+    }
+
+    m_order.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        m_sorted[i] = faces[m_merged[i].face];
+        m_order[i] = m_sorted[i].id;
+    }
+    // Both buffers have the same size, so swapping them keeps the frame valid
+    frame.visible_faces.swap(m_sorted);
+}
+
+void DepthSorter::Reset()
+{
+    m_order.clear();
+}
+
+}  // namespace rubiks
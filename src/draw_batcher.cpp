@@ -0,0 +1,189 @@
+#include "draw_batcher.hpp"
+#include <algorithm>
+#include <cmath>
+#include "profiler.hpp"
+
+namespace rubiks {
+
+namespace {
+
+// Quads overlapping less than this are treated as touching
+const double OVERLAP_EPSILON = 1e-6;
+
+const int MAX_GRID_SIZE = 64;
+
+// Returns true if an edge of quad a separates the quads
+bool HasSeparatingEdge(const double* ax, const double* ay, const double* bx, const double* by)
+{
+    for (int i = 0; i < 4; i++) {
+        int next = (i + 1) % 4;
+        double nx = ay[i] - ay[next];
+        double ny = ax[next] - ax[i];
+        double length = std::sqrt(nx * nx + ny * ny);
+        if (length < OVERLAP_EPSILON)
+            continue;  // degenerate edge
+        double a_min = nx * ax[0] + ny * ay[0];
+        double a_max = a_min;
+        double b_min = nx * bx[0] + ny * by[0];
+        double b_max = b_min;
+        for (int k = 1; k < 4; k++) {
+            double pa = nx * ax[k] + ny * ay[k];
+            double pb = nx * bx[k] + ny * by[k];
+            a_min = std::min(a_min, pa);
+            a_max = std::max(a_max, pa);
+            b_min = std::min(b_min, pb);
+            b_max = std::max(b_max, pb);
+        }
+        if (std::min(a_max, b_max) - std::max(a_min, b_min) <= OVERLAP_EPSILON * length)
+            return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+bool QuadsOverlap(const VertexArray& vertices, const Quad& a, const Quad& b)
+{
+    const int ia[4] = { a.v1, a.v2, a.v3, a.v4 };
+    const int ib[4] = { b.v1, b.v2, b.v3, b.v4 };
+    double ax[4], ay[4], bx[4], by[4];
+    for (int k = 0; k < 4; k++) {
+        ax[k] = vertices.x[ia[k]];
+        ay[k] = vertices.y[ia[k]];
+        bx[k] = vertices.x[ib[k]];
+        by[k] = vertices.y[ib[k]];
+    }
+    // Separating axis theorem for convex polygons
+    return !HasSeparatingEdge(ax, ay, bx, by) && !HasSeparatingEdge(bx, by, ax, ay);
+}
+
+void DrawBatcher::CellRange(const Bounds& b, int* x_begin, int* y_begin,
+                            int* x_end, int* y_end) const
+{
+    int last = m_grid_size - 1;
+    *x_begin = std::min(last, std::max(0, int((b.left - m_grid_left) * m_cell_scale)));
+    *y_begin = std::min(last, std::max(0, int((b.top - m_grid_top) * m_cell_scale)));
+    *x_end = std::min(last, std::max(0, int((b.right - m_grid_left) * m_cell_scale))) + 1;
+    *y_end = std::min(last, std::max(0, int((b.bottom - m_grid_top) * m_cell_scale))) + 1;
+}
+
+bool DrawBatcher::IsCovered(const FrameContext& frame, uint32_t face, uint32_t batch) const
+{
+    const Bounds& b = m_bounds[face];
+    int x_begin, y_begin, x_end, y_end;
+    CellRange(b, &x_begin, &y_begin, &x_end, &y_end);
+    size_t checks = 0;
+    for (int cy = y_begin; cy < y_end; cy++) {
+        for (int cx = x_begin; cx < x_end; cx++) {
+            for (uint32_t other : m_cells[cy * m_grid_size + cx]) {
+                if (m_batch_of[other] <= batch)
+                    continue;
+                if (++checks > MAX_CHECKS_PER_FACE)
+                    return true;  // too crowded to tell quickly
+                const Bounds& o = m_bounds[other];
+                if (b.left >= o.right || o.left >= b.right ||
+                    b.top >= o.bottom || o.top >= b.bottom)
+                    continue;
+                if (QuadsOverlap(frame.projected_vertices, frame.visible_faces[face],
+                                 frame.visible_faces[other]))
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+const std::vector<DrawBatch>& DrawBatcher::Batch(const FrameContext& frame)
+{
+    RUBIKS_PROFILE_SCOPE("Batch");
+    size_t n = frame.visible_face_count;
+    const VertexArray& vertices = frame.projected_vertices;
+    m_batches.clear();
+    m_faces.resize(n);
+    m_last_batches.clear();
+    if (n == 0)
+        return m_batches;
+
+    // Bounds and winding of faces
+    m_batch_of.resize(n);
+    m_bounds.resize(n);
+    m_reversed.resize(n);
+    Bounds all = Bounds();
+    for (size_t i = 0; i < n; i++) {
+        const Quad& q = frame.visible_faces[i];
+        const int v[4] = { q.v1, q.v2, q.v3, q.v4 };
+        Bounds& b = m_bounds[i];
+        b = { vertices.x[v[0]], vertices.y[v[0]], vertices.x[v[0]], vertices.y[v[0]] };
+        double area = 0;  // twice the signed area
+        for (int k = 0; k < 4; k++) {
+            double x = vertices.x[v[k]];
+            double y = vertices.y[v[k]];
+            b.left = std::min(b.left, x);
+            b.top = std::min(b.top, y);
+            b.right = std::max(b.right, x);
+            b.bottom = std::max(b.bottom, y);
+            int next = v[(k + 1) % 4];
+            area += x * vertices.y[next] - vertices.x[next] * y;
+        }
+        m_reversed[i] = area < 0;
+        if (i == 0)
+            all = b;
+        all.left = std::min(all.left, b.left);
+        all.top = std::min(all.top, b.top);
+        all.right = std::max(all.right, b.right);
+        all.bottom = std::max(all.bottom, b.bottom);
+    }
+
+    // About one face per cell
+    m_grid_size = std::min(MAX_GRID_SIZE, std::max(1, int(std::sqrt(double(n)))));
+    m_cells.resize(size_t(m_grid_size) * size_t(m_grid_size));
+    for (std::vector<uint32_t>& cell : m_cells)
+        cell.clear();
+    m_grid_left = all.left;
+    m_grid_top = all.top;
+    double extent = std::max(all.right - all.left, all.bottom - all.top);
+    m_cell_scale = (extent > 0) ? m_grid_size / extent : 0.0;
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t face = uint32_t(i);
+        uint32_t color = frame.visible_faces[i].color;
+        size_t last = 0;
+        while (last < m_last_batches.size() && m_last_batches[last].first != color)
+            last++;
+
+        uint32_t batch;
+        if (last < m_last_batches.size() && !IsCovered(frame, face, m_last_batches[last].second)) {
+            batch = m_last_batches[last].second;
+        } else {
+            batch = uint32_t(m_batches.size());
+            m_batches.push_back({ color, 0, 0 });
+            if (last < m_last_batches.size())
+                m_last_batches[last].second = batch;
+            else
+                m_last_batches.push_back(std::make_pair(color, batch));
+        }
+        m_batches[batch].count++;
+        m_batch_of[i] = batch;
+
+        int x_begin, y_begin, x_end, y_end;
+        CellRange(m_bounds[i], &x_begin, &y_begin, &x_end, &y_end);
+        for (int cy = y_begin; cy < y_end; cy++)
+            for (int cx = x_begin; cx < x_end; cx++)
+                m_cells[cy * m_grid_size + cx].push_back(face);
+    }
+
+    // Group faces by batch, keeping the order of the frame in each batch
+    size_t offset = 0;
+    for (DrawBatch& batch : m_batches) {
+        batch.first = offset;
+        offset += batch.count;
+        batch.count = 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        DrawBatch& batch = m_batches[m_batch_of[i]];
+        m_faces[batch.first + batch.count++] = { uint32_t(i), m_reversed[i] };
+    }
+    return m_batches;
+}
+
+}  // namespace rubiks
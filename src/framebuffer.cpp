@@ -0,0 +1,143 @@
+#include "framebuffer.hpp"
+#include <stdio.h>
+#include <algorithm>
+
+namespace rubiks {
+
+namespace {
+
+// Max data size of a stored deflate block
+const size_t STORED_BLOCK_SIZE = 65535;
+
+struct Crc32Table {
+    uint32_t values[256];
+
+    Crc32Table()
+    {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            values[i] = c;
+        }
+    }
+};
+
+uint32_t Crc32(const uint8_t* data, size_t size)
+{
+    static const Crc32Table table;
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++)
+        crc = table.values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void PutU32BE(std::vector<uint8_t>* out, uint32_t value)
+{
+    out->push_back(uint8_t(value >> 24));
+    out->push_back(uint8_t(value >> 16));
+    out->push_back(uint8_t(value >> 8));
+    out->push_back(uint8_t(value));
+}
+
+bool WriteChunk(FILE* fp, const char* type, const std::vector<uint8_t>& data)
+{
+    std::vector<uint8_t> chunk;
+    PutU32BE(&chunk, uint32_t(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    PutU32BE(&chunk, Crc32(chunk.data() + 4, chunk.size() - 4));
+    return fwrite(chunk.data(), 1, chunk.size(), fp) == chunk.size();
+}
+
+}  // namespace
+
+bool Framebuffer::SavePPM(const std::string& path) const
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp)
+        return false;
+    fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    std::vector<uint8_t> row(size_t(width) * 3);
+    bool ok = true;
+    for (int y = 0; y < height && ok; y++) {
+        const uint8_t* src = reinterpret_cast<const uint8_t*>(Row(y));
+        for (int x = 0; x < width; x++) {
+            row[x * 3] = src[x * 4];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        ok = fwrite(row.data(), 1, row.size(), fp) == row.size();
+    }
+    return (fclose(fp) == 0) && ok;
+}
+
+bool Framebuffer::SavePNG(const std::string& path) const
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp)
+        return false;
+
+    static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    bool ok = fwrite(SIGNATURE, 1, 8, fp) == 8;
+
+    std::vector<uint8_t> header;
+    PutU32BE(&header, uint32_t(width));
+    PutU32BE(&header, uint32_t(height));
+    header.push_back(8);  // bit depth
+    header.push_back(6);  // RGBA
+    header.push_back(0);  // deflate
+    header.push_back(0);  // adaptive filtering
+    header.push_back(0);  // no interlace
+    ok = ok && WriteChunk(fp, "IHDR", header);
+
+    // Scanlines with filter type 0 (none)
+    size_t row_size = size_t(width) * 4;
+    std::vector<uint8_t> raw;
+    raw.reserve((row_size + 1) * size_t(height));
+    for (int y = 0; y < height; y++) {
+        const uint8_t* src = reinterpret_cast<const uint8_t*>(Row(y));
+        raw.push_back(0);
+        raw.insert(raw.end(), src, src + row_size);
+    }
+
+    // zlib stream of stored blocks
+    std::vector<uint8_t> zlib;
+    zlib.reserve(raw.size() + raw.size() / STORED_BLOCK_SIZE * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    size_t pos = 0;
+    do {
+        size_t size = std::min(STORED_BLOCK_SIZE, raw.size() - pos);
+        bool last = pos + size == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(uint8_t(size));
+        zlib.push_back(uint8_t(size >> 8));
+        zlib.push_back(uint8_t(~size));
+        zlib.push_back(uint8_t(~size >> 8));
+        zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + size);
+        pos += size;
+    } while (pos < raw.size());
+
+    // Adler-32 of the raw data
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < raw.size(); i++) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    PutU32BE(&zlib, (b << 16) | a);
+
+    ok = ok && WriteChunk(fp, "IDAT", zlib);
+    ok = ok && WriteChunk(fp, "IEND", std::vector<uint8_t>());
+    return (fclose(fp) == 0) && ok;
+}
+
+bool Framebuffer::Save(const std::string& path) const
+{
+    size_t n = path.size();
+    if (n >= 4 && path.compare(n - 4, 4, ".png") == 0)
+        return SavePNG(path);
+    return SavePPM(path);
+}
+
+}  // namespace rubiks
@@ -1,13 +1,49 @@
 #include <stdio.h>
 #include <string.h>
+#include <atomic>
+#include <random>
 #include "ui.h"
+#include "alloc_tracker.hpp"  // AllocationCounter, AllocationBudget
 #include "geometry.hpp"  // Vec3D, Matrix3D
 #include "rubiks.hpp"  // RubiksCube
-#include "rubiks_handler.hpp"  // AnimationHandler, MouseHander, Scrambler
+#include "rubiks_handler.hpp"  // AnimationHandler, MouseHander
+#include "background_solver.hpp"  // BackgroundSolver
+#include "draw_batcher.hpp"  // DrawBatcher
+#include "render_backend.hpp"  // RenderBackend
+#include "optimal_solver.hpp"  // OptimalSolver
+#include "profiler.hpp"  // Profiler, RUBIKS_PROFILE_SCOPE
+#include "scrambler.hpp"  // Scrambler
+#include "table_cache.hpp"  // TableCachePath
+#include "two_phase_solver.hpp"  // TwoPhaseSolver
 
 rubiks::RubiksCube g_rubiks;
 rubiks::AnimationHandler *g_animation_handler;
 rubiks::MouseHandler *g_mouse_handler;
+rubiks::TwoPhaseTables g_two_phase_tables;
+rubiks::OptimalSolver *g_optimal_solver = nullptr;  // created at the first optimal solve
+rubiks::BackgroundSolver g_background_solver;
+rubiks::DrawBatcher g_draw_batcher;
+bool g_solving_optimal = false;
+bool g_solve_cancelled = false;
+// Percent of the optimal solver tables generated by the background solver, or -1
+std::atomic<int> g_table_progress(-1);
+int g_shown_table_progress = -1;
+bool g_scrambling = false;  // the background solver makes a random state scramble
+// Scrambles of a session come from one seed, as scramble 0, 1, 2, ...
+uint32_t g_scramble_seed;
+uint64_t g_scramble_count = 0;
+uiCheckbox *g_optimal_checkbox;
+uiLabel *g_solver_label;
+uiLabel *g_frame_label;  // frame times of animations
+#ifdef RUBIKS_PROFILER
+uiCheckbox *g_profiler_checkbox;
+#endif
+#ifdef RUBIKS_ALLOC_TRACKER
+// Frames and animation steps should not allocate once buffers have grown.
+// The counts are printed when the app quits.
+rubiks::AllocationBudget g_frame_allocs("frame", 0);
+rubiks::AllocationBudget g_step_allocs("animation step", 0);
+#endif
 uiAreaHandler handler;
 
 // helper to quickly set a brush color
@@ -25,51 +61,126 @@ static void SetSolidBrush(uiDrawBrush *brush, uint32_t color, double alpha)
     brush->A = alpha;
 }
 
-// helper to draw a quad face
-static void DrawQuad(uiAreaDrawParams *p, const std::vector<Vec3D>& vertices, const Quad& face)
-{
-    uiDrawPath *path;
-    uiDrawBrush brush;
-    SetSolidBrush(&brush, face.color, 1.0);
-    path = uiDrawNewPath(uiDrawFillModeWinding);
+// Render backend drawing with libui paths.
+// Native paths and fills are costly, so faces are filled in batches of the same color.
+class LibuiRenderer : public rubiks::RenderBackend {
+ private:
+    uiAreaDrawParams *m_params;
+    rubiks::DrawBatcher *m_batcher;
+
+    void AddQuad(uiDrawPath *path, const VertexArray& vertices, const Quad& face, bool reversed)
+    {
+        Vec3D v1 = vertices.Get(reversed ? face.v4 : face.v1);
+        Vec3D v2 = vertices.Get(reversed ? face.v3 : face.v2);
+        Vec3D v3 = vertices.Get(reversed ? face.v2 : face.v3);
+        Vec3D v4 = vertices.Get(reversed ? face.v1 : face.v4);
+        uiDrawPathNewFigure(path, v1.x, v1.y);
+        uiDrawPathLineTo(path, v2.x, v2.y);
+        uiDrawPathLineTo(path, v3.x, v3.y);
+        uiDrawPathLineTo(path, v4.x, v4.y);
+        uiDrawPathCloseFigure(path);
+    }
+
+    void FillBatch(const FrameContext& frame, const rubiks::DrawBatch& batch)
+    {
+        uiDrawPath *path;
+        uiDrawBrush brush;
+        SetSolidBrush(&brush, batch.color, 1.0);
+        // Faces of a batch have the same winding, so overlapping faces don't make holes.
+        path = uiDrawNewPath(uiDrawFillModeWinding);
+
+        const std::vector<rubiks::BatchedFace>& faces = m_batcher->Faces();
+        for (size_t i = batch.first; i < batch.first + batch.count; i++) {
+            AddQuad(path, frame.projected_vertices,
+                    frame.visible_faces[faces[i].face], faces[i].reversed);
+        }
+
+        uiDrawPathEnd(path);
+        uiDrawFill(m_params->Context, path, &brush);
+        uiDrawFreePath(path);
+    }
 
-    Vec3D v1 = vertices[face.v1];
-    Vec3D v2 = vertices[face.v2];
-    Vec3D v3 = vertices[face.v3];
-    Vec3D v4 = vertices[face.v4];
-    uiDrawPathNewFigure(path, v1.x, v1.y);
-    uiDrawPathLineTo(path, v2.x, v2.y);
-    uiDrawPathLineTo(path, v3.x, v3.y);
-    uiDrawPathLineTo(path, v4.x, v4.y);
-    uiDrawPathCloseFigure(path);
+ public:
+    LibuiRenderer(uiAreaDrawParams *params, rubiks::DrawBatcher *batcher) :
+        m_params(params), m_batcher(batcher) {}
+
+    void DrawFrame(const FrameContext& frame, uint32_t background) override
+    {
+        // fill the area
+        uiDrawPath *path;
+        uiDrawBrush brush;
+        SetSolidBrush(&brush, background, 1.0);
+        path = uiDrawNewPath(uiDrawFillModeWinding);
+        uiDrawPathAddRectangle(path, 0, 0, m_params->AreaWidth, m_params->AreaHeight);
+        uiDrawPathEnd(path);
+        uiDrawFill(m_params->Context, path, &brush);
+        uiDrawFreePath(path);
+
+        // Draw faces
+        const std::vector<rubiks::DrawBatch>& batches = m_batcher->Batch(frame);
+        RUBIKS_PROFILE_SCOPE("Fill");
+        for (const rubiks::DrawBatch& batch : batches)
+            FillBatch(frame, batch);
+    }
+};
 
-    uiDrawPathEnd(path);
-    uiDrawFill(p->Context, path, &brush);
-    uiDrawFreePath(path);
+static std::string FormatFrameStats(const rubiks::FrameStats& stats)
+{
+    char line[160];
+    snprintf(line, sizeof(line),
+             "%zu frames, %zu dropped, last %.1f ms, avg %.1f ms, max %.1f ms",
+             stats.frames, stats.dropped, stats.last * 1e3, stats.average * 1e3, stats.max * 1e3);
+    return line;
 }
 
+#ifdef RUBIKS_PROFILER
+// Draw percentiles of the profiler at the top left corner
+static void DrawProfilerOverlay(uiAreaDrawParams *p)
+{
+    std::string text = "animation: " + FormatFrameStats(g_animation_handler->Stats()) + "\n" +
+                       rubiks::Profiler::Get().FormatStats();
+    uiAttributedString *str = uiNewAttributedString(text.c_str());
+    char family[] = "Courier New";
+    uiFontDescriptor font;
+    font.Family = family;
+    font.Size = 9;
+    font.Weight = uiTextWeightNormal;
+    font.Italic = uiTextItalicNormal;
+    font.Stretch = uiTextStretchNormal;
+
+    uiDrawTextLayoutParams params;
+    params.String = str;
+    params.DefaultFont = &font;
+    params.Width = p->AreaWidth;
+    params.Align = uiDrawTextAlignLeft;
+    uiDrawTextLayout *layout = uiDrawNewTextLayout(&params);
+    uiDrawText(p->Context, layout, 4, 4);
+    uiDrawFreeTextLayout(layout);
+    uiFreeAttributedString(str);
+}
+#endif
+
 // This will be called by uiAreaQueueRedrawAll
 static void HandlerDraw(uiAreaHandler *a, uiArea *area, uiAreaDrawParams *p)
 {
-    // Project rubiks cube to screen
-    std::vector<Vec3D> projected_vertices;
-    std::vector<Quad> visible_faces;
-    g_rubiks.Project(projected_vertices, visible_faces);
-
-    // fill the area
-    uiDrawPath *path;
-    uiDrawBrush brush;
-    SetSolidBrush(&brush, rubiks::COLOR_GRAY, 1.0);
-    path = uiDrawNewPath(uiDrawFillModeWinding);
-    uiDrawPathAddRectangle(path, 0, 0, p->AreaWidth, p->AreaHeight);
-    uiDrawPathEnd(path);
-    uiDrawFill(p->Context, path, &brush);
-    uiDrawFreePath(path);
-
-    // Draw faces    
-    for (const Quad& face: visible_faces) {
-        DrawQuad(p, projected_vertices, face);
+    {
+#ifdef RUBIKS_ALLOC_TRACKER
+        rubiks::AllocationCounter counter;
+#endif
+        RUBIKS_PROFILE_SCOPE("Draw");
+        // Project rubiks cube to screen
+        const FrameContext& frame = g_rubiks.Project();
+
+        LibuiRenderer renderer(p, &g_draw_batcher);
+        renderer.DrawFrame(frame, rubiks::COLOR_GRAY);
+#ifdef RUBIKS_ALLOC_TRACKER
+        g_frame_allocs.Add(counter.Count());
+#endif
     }
+#ifdef RUBIKS_PROFILER
+    if (uiCheckboxChecked(g_profiler_checkbox))
+        DrawProfilerOverlay(p);
+#endif
 }
 
 static void HandlerMouseEvent(uiAreaHandler *a, uiArea *area, uiAreaMouseEvent *e)
@@ -131,27 +242,244 @@ static void OnResetColors(uiButton *sender, void *data) {
 
 const int SCRAMBLE_STEPS = 50;
 
+static bool SolveTwoPhase(const rubiks::CubieCube& cube, std::vector<int>* solution)
+{
+    rubiks::TwoPhaseSolver solver(&g_two_phase_tables);
+    return solver.Solve(cube, solution);
+}
+
+static void PushScramble(const std::vector<rubiks::NotationMove>& scramble)
+{
+    std::vector<rubiks::AnimationQueue> queues;
+    rubiks::MakeMoveQueues(g_rubiks.cube_num, scramble, &queues);
+    for (const rubiks::AnimationQueue& queue : queues)
+        g_animation_handler->Push(queue);
+}
+
 static void OnScramble(uiButton *sender, void *data) {
-    if (g_animation_handler->IsAnimating()) return;
+    if (g_animation_handler->IsAnimating() || g_background_solver.IsRunning()) return;
 
     g_mouse_handler->InitializeState();
     g_rubiks.InitializeFaceRotation();
 
-    rubiks::Scrambler scrambler;
-    for (int i = 0; i < SCRAMBLE_STEPS; i++) {
-        rubiks::AnimationQueue queue = scrambler.GenerateFaceRotation();
-        g_animation_handler->Push(queue);
+    // 3x3 cubes get random states. Other sizes get random moves.
+    rubiks::ScrambleType type = (g_rubiks.cube_num == 3) ?
+        rubiks::SCRAMBLE_RANDOM_STATE : rubiks::SCRAMBLE_RANDOM_MOVES;
+    rubiks::Scrambler scrambler(g_rubiks.cube_num, type, &g_two_phase_tables);
+    scrambler.SetMoveNum(SCRAMBLE_STEPS);
+    scrambler.Seed(g_scramble_seed, g_scramble_count++);
+    if (type == rubiks::SCRAMBLE_RANDOM_STATE) {
+        // Solve the random state on another thread, and invert it in OnScrambled()
+        g_scrambling = true;
+        g_solving_optimal = false;
+        g_background_solver.Start(scrambler.RandomCube(), SolveTwoPhase);
+        uiLabelSetText(g_solver_label, "Scrambling...");
+        return;
+    }
+    std::vector<rubiks::NotationMove> scramble;
+    scrambler.RandomMoves(&scramble);
+    PushScramble(scramble);
+}
+
+static void OnScrambled()
+{
+    g_scrambling = false;
+    uiLabelSetText(g_solver_label, "");
+    if (g_animation_handler->IsAnimating() || g_rubiks.cube_num != 3) return;
+
+    std::vector<rubiks::NotationMove> scramble;
+    if (g_background_solver.Found()) {
+        rubiks::InvertSolution(g_background_solver.Solution(), &scramble);
+    } else {
+        // The solver timed out. Use random moves from the same seed.
+        rubiks::Scrambler scrambler(g_rubiks.cube_num);
+        scrambler.SetMoveNum(SCRAMBLE_STEPS);
+        scrambler.Seed(g_scramble_seed, g_scramble_count - 1);
+        scrambler.RandomMoves(&scramble);
+    }
+    g_mouse_handler->InitializeState();
+    g_rubiks.InitializeFaceRotation();
+    PushScramble(scramble);
+}
+
+// Called on the background solver thread. OnAnimating() shows the percent.
+static void OnTableProgress(int table, int table_num, int depth, uint64_t visited, uint64_t size)
+{
+    g_table_progress = int((table + double(visited) / double(size)) * 100.0 / table_num);
+}
+
+static bool SolveOptimal(const rubiks::CubieCube& cube, std::vector<int>* solution)
+{
+    // It takes tens of seconds to generate the tables at the first run.
+    bool ready = g_optimal_solver->Initialize(rubiks::TableCachePath("optimal.tbl"), OnTableProgress);
+    g_table_progress = -1;
+    return ready && g_optimal_solver->Solve(cube, solution);
+}
+
+static void OnSolve(uiButton *sender, void *data) {
+    if (g_background_solver.IsRunning()) {
+        // Cancel the running search or table generation.
+        // The two-phase solver stops soon by itself.
+        if (g_solving_optimal && !g_solve_cancelled) {
+            g_optimal_solver->Cancel();
+            g_solve_cancelled = true;
+            uiLabelSetText(g_solver_label, "Cancelling...");
+        }
+        return;
+    }
+
+    // The solvers only support 3x3 cubes
+    if (g_animation_handler->IsAnimating() || g_rubiks.cube_num != 3) return;
+
+    g_mouse_handler->InitializeState();
+    g_rubiks.InitializeFaceRotation();
+
+    rubiks::CubieCube cube;
+    if (!cube.FromRubiksCube(g_rubiks)) {
+        uiLabelSetText(g_solver_label, "Can't read the cube");
+        return;
+    }
+
+    // Solve the cube on another thread, and get the result in OnAnimating()
+    g_solving_optimal = uiCheckboxChecked(g_optimal_checkbox);
+    g_solve_cancelled = false;
+    if (g_solving_optimal) {
+        // Its thread pool takes all cores, so it's not made until it's needed
+        if (!g_optimal_solver)
+            g_optimal_solver = new rubiks::OptimalSolver();
+        g_background_solver.Start(cube, SolveOptimal);
+    } else {
+        g_background_solver.Start(cube, SolveTwoPhase);
+    }
+    uiLabelSetText(g_solver_label, "Solving...");
+}
+
+// Check a solution on a copy of the stickers, apart from the cubie conversion
+static bool SolvesCube(const std::vector<int>& solution)
+{
+    std::vector<uint8_t> facelets = g_rubiks.facelets;
+    std::vector<uint8_t> work(g_rubiks.move_table.max_move_size);
+    for (int move : solution) {
+        int axis, layer, degree;
+        rubiks::FaceTurnToLayerMove(3, move / 3, 0, move % 3 + 1, &axis, &layer, &degree);
+        g_rubiks.move_table.Apply(g_rubiks.move_table.MoveIndex(axis, layer, degree),
+                                  facelets.data(), work.data());
+    }
+    for (int i = 0; i < 54; i++) {
+        if (facelets[i] != facelets[i / 9 * 9 + 4])
+            return false;
+    }
+    return true;
+}
+
+static void OnSolved()
+{
+    if (!g_background_solver.Found()) {
+        uiLabelSetText(g_solver_label, g_solve_cancelled ? "Cancelled" : "No solution");
+        return;
+    }
+
+    // Discard the solution if the cube was turned during the search
+    rubiks::CubieCube cube;
+    if (g_animation_handler->IsAnimating() || g_rubiks.cube_num != 3 ||
+        !cube.FromRubiksCube(g_rubiks) || cube != g_background_solver.Cube()) {
+        uiLabelSetText(g_solver_label, "The cube was changed");
+        return;
+    }
+
+    const std::vector<int>& solution = g_background_solver.Solution();
+    if (!SolvesCube(solution)) {
+        uiLabelSetText(g_solver_label, "The solution doesn't solve the cube");
+        return;
     }
+    char text[64];
+    snprintf(text, sizeof(text), "Solved in %d moves", int(solution.size()));
+    uiLabelSetText(g_solver_label, text);
+
+    g_mouse_handler->InitializeState();
+    g_rubiks.InitializeFaceRotation();
+    std::vector<rubiks::AnimationQueue> queues;
+    rubiks::MakeFaceTurnQueues(g_rubiks.cube_num, solution, &queues);
+    for (const rubiks::AnimationQueue& queue : queues)
+        g_animation_handler->Push(queue);
+}
+
+#ifdef RUBIKS_PROFILER
+static void OnProfilerToggled(uiCheckbox *sender, void *data) {
+    g_animation_handler->ResetStats();
+    uiLabelSetText(g_frame_label, "");
+    uiAreaQueueRedrawAll(uiArea(data));
+}
+
+static void OnSaveTrace(uiButton *sender, void *data) {
+    char *path = uiSaveFile(uiWindow(data));
+    if (path == NULL) return;
+    if (!rubiks::Profiler::Get().WriteTrace(path))
+        uiMsgBoxError(uiWindow(data), "Error", "Failed to write the trace file.");
+    uiFreeText(path);
+}
+#endif
+
+// Choices of the frame rate of animations. 0 draws a frame for every timer tick.
+const int FPS_CHOICES[] = { 30, 60, 120, 0 };
+const char* FPS_CHOICE_NAMES[] = { "30 fps", "60 fps", "120 fps", "Unlimited" };
+const int FPS_CHOICE_NUM = 4;
+
+static void OnFpsSelected(uiCombobox *sender, void *data) {
+    int choice = uiComboboxSelected(sender);
+    if (choice < 0 || choice >= FPS_CHOICE_NUM) return;
+    g_animation_handler->SetTargetFps(FPS_CHOICES[choice]);
+    g_animation_handler->ResetStats();
+    uiLabelSetText(g_frame_label, "");
+}
+
+static void OnCubeNumChanged(uiSpinbox *sender, void *data) {
+    g_animation_handler->ClearAnimations();
+    g_mouse_handler->InitializeState();
+    g_rubiks.Initialize(uiSpinboxValue(sender));
+    uiAreaQueueRedrawAll(uiArea(data));
 }
 
 static int OnAnimating(void *data)
 {
+    // Check the background solver
+    if (g_background_solver.Poll()) {
+        g_shown_table_progress = -1;
+        if (g_scrambling)
+            OnScrambled();
+        else
+            OnSolved();
+    } else if (g_background_solver.IsRunning() && !g_solve_cancelled) {
+        // Show the progress of table generation, and "Solving..." again after it
+        int progress = g_table_progress;
+        if (progress != g_shown_table_progress) {
+            char text[64];
+            if (progress >= 0)
+                snprintf(text, sizeof(text), "Generating tables... %d%%", progress);
+            else
+                snprintf(text, sizeof(text), "Solving...");
+            uiLabelSetText(g_solver_label, text);
+            g_shown_table_progress = progress;
+        }
+    }
+
     // Process animation queues
+#ifdef RUBIKS_ALLOC_TRACKER
+    rubiks::AllocationCounter counter;
+    int animated = g_animation_handler->Step();
+    if (animated)
+        g_step_allocs.Add(counter.Count());
+#else
     int animated = g_animation_handler->Step();
+#endif
 
     if (animated)
         uiAreaQueueRedrawAll(uiArea(data));
 
+    // Show frame times when an animation ends
+    if (animated && !g_animation_handler->IsAnimating())
+        uiLabelSetText(g_frame_label, FormatFrameStats(g_animation_handler->Stats()).c_str());
+
     return 1;
 }
 
@@ -178,6 +506,8 @@ void CreateWindow()
     uiArea *area = uiNewArea(&handler);
     uiBoxAppend(vbox, uiControl(area), 1);
 
+    // Animations are timed with a monotonic clock and limited to the target frame rate,
+    // so the timer only has to tick more often than the frame rate.
     uiTimer(10, OnAnimating, area);
 
     // Buttons
@@ -196,6 +526,43 @@ void CreateWindow()
     uiButtonOnClicked(button, OnScramble, area);
     uiBoxAppend(button_box, uiControl(button), 0);
 
+    button = uiNewButton("Solve");
+    uiButtonOnClicked(button, OnSolve, area);
+    uiBoxAppend(button_box, uiControl(button), 0);
+
+    g_optimal_checkbox = uiNewCheckbox("Optimal");
+    uiBoxAppend(button_box, uiControl(g_optimal_checkbox), 0);
+
+    uiSpinbox *spinbox = uiNewSpinbox(rubiks::MIN_CUBE_NUM, rubiks::MAX_CUBE_NUM);
+    uiSpinboxSetValue(spinbox, g_rubiks.cube_num);
+    uiSpinboxOnChanged(spinbox, OnCubeNumChanged, area);
+    uiBoxAppend(button_box, uiControl(spinbox), 0);
+
+    uiCombobox *fps_combobox = uiNewCombobox();
+    for (int i = 0; i < FPS_CHOICE_NUM; i++) {
+        uiComboboxAppend(fps_combobox, FPS_CHOICE_NAMES[i]);
+        if (FPS_CHOICES[i] == rubiks::AnimationHandler::DEFAULT_TARGET_FPS)
+            uiComboboxSetSelected(fps_combobox, i);
+    }
+    uiComboboxOnSelected(fps_combobox, OnFpsSelected, NULL);
+    uiBoxAppend(button_box, uiControl(fps_combobox), 0);
+
+    g_frame_label = uiNewLabel("");
+    uiBoxAppend(button_box, uiControl(g_frame_label), 0);
+
+#ifdef RUBIKS_PROFILER
+    g_profiler_checkbox = uiNewCheckbox("Profiler");
+    uiCheckboxOnToggled(g_profiler_checkbox, OnProfilerToggled, area);
+    uiBoxAppend(button_box, uiControl(g_profiler_checkbox), 0);
+
+    button = uiNewButton("Save Trace");
+    uiButtonOnClicked(button, OnSaveTrace, mainwin);
+    uiBoxAppend(button_box, uiControl(button), 0);
+#endif
+
+    g_solver_label = uiNewLabel("");
+    uiBoxAppend(button_box, uiControl(g_solver_label), 0);
+
     uiBoxAppend(vbox, uiControl(button_box), 0);
 
     // Make them visible
@@ -218,6 +585,10 @@ int main(void)
 
     // Initialize rubiks cube
     g_rubiks.Initialize();
+
+    // Map the solver tables. They are generated only when the cache is missing or stale.
+    g_two_phase_tables.Build(rubiks::TableCachePath("two_phase.tbl"));
+    g_scramble_seed = std::random_device()();
     g_animation_handler = new rubiks::AnimationHandler(&g_rubiks);
     g_mouse_handler = new rubiks::MouseHandler(&g_rubiks, g_animation_handler);
 
@@ -227,7 +598,14 @@ int main(void)
     // Start main loop
     uiMain();
 
+    if (g_background_solver.IsRunning() && g_solving_optimal)
+        g_optimal_solver->Cancel();
+    g_background_solver.Wait();
+    delete g_optimal_solver;
     delete g_animation_handler;
     delete g_mouse_handler;
+#ifdef RUBIKS_ALLOC_TRACKER
+    fprintf(stderr, "%s\n%s\n", g_frame_allocs.Format().c_str(), g_step_allocs.Format().c_str());
+#endif
     return 0;
 }
@@ -0,0 +1,106 @@
+#include "move_program.hpp"
+
+namespace rubiks {
+
+void MoveProgram::Reset(int cube_num)
+{
+    m_cube_num = cube_num;
+    m_code.clear();
+    m_run_start = 0;
+    m_appended = 0;
+}
+
+void MoveProgram::AppendLayerMove(int axis, int layer, int degree)
+{
+    degree %= 4;
+    if (degree == 0)
+        return;
+    m_appended++;
+
+    if (m_run_start < m_code.size() && InstructionAxis(m_code[m_run_start]) != axis)
+        m_run_start = m_code.size();
+
+    // Instructions of a layer are 3 apart from each other
+    int layer_code = ((axis - 1) * m_cube_num + layer) * 3;
+    for (size_t i = m_run_start; i < m_code.size(); i++) {
+        int old_degree = m_code[i] - layer_code + 1;
+        if (old_degree < DEGREE_90 || old_degree > DEGREE_270)
+            continue;
+        int new_degree = (old_degree + degree) % 4;
+        if (new_degree != 0) {
+            m_code[i] = uint16_t(layer_code + new_degree - 1);
+            return;
+        }
+        m_code.erase(m_code.begin() + i);
+        if (m_run_start == m_code.size() && !m_code.empty()) {
+            // The run is gone. Moves can merge into the one before it.
+            int last_axis = InstructionAxis(m_code.back());
+            m_run_start = m_code.size() - 1;
+            while (m_run_start > 0 && InstructionAxis(m_code[m_run_start - 1]) == last_axis)
+                m_run_start--;
+        }
+        return;
+    }
+    m_code.push_back(uint16_t(layer_code + degree - 1));
+}
+
+void MoveProgram::Append(const NotationMove& move)
+{
+    int face, first_depth, last_depth;
+    NotationMoveLayers(move, m_cube_num, &face, &first_depth, &last_depth);
+    if (move.turns == 0)
+        return;
+    for (int depth = first_depth; depth <= last_depth; depth++) {
+        int axis, layer, degree;
+        FaceTurnToLayerMove(m_cube_num, face, depth, move.turns, &axis, &layer, &degree);
+        AppendLayerMove(axis, layer, degree);
+    }
+}
+
+void MoveProgram::Append(const std::vector<NotationMove>& moves)
+{
+    for (const NotationMove& move : moves)
+        Append(move);
+}
+
+void MoveProgram::Apply(const FaceletMoveTable& table, uint8_t* facelets, uint8_t* work,
+                        size_t begin, size_t end) const
+{
+    const int* offsets = table.offsets.data();
+    const int* targets = table.targets.data();
+    const int* sources = table.sources.data();
+    for (size_t i = begin; i < end; i++) {
+        int move = m_code[i];
+        int first = offsets[move];
+        int size = offsets[move + 1] - first;
+        const int* src = sources + first;
+        const int* dst = targets + first;
+        for (int k = 0; k < size; k++)
+            work[k] = facelets[src[k]];
+        for (int k = 0; k < size; k++)
+            facelets[dst[k]] = work[k];
+    }
+}
+
+bool MoveProgram::Apply(RubiksCube* rubiks, size_t begin, size_t end) const
+{
+    if (rubiks->cube_num != m_cube_num)
+        return false;
+    if (begin >= end)
+        return true;
+    Apply(rubiks->move_table, rubiks->facelets.data(), rubiks->move_work.data(), begin, end);
+    rubiks->cache.InvalidateFrame();
+    return true;
+}
+
+bool CompileMoves(const std::string& text, int cube_num, MoveProgram* program)
+{
+    std::vector<NotationMove> moves;
+    if (!ParseMoves(text, cube_num, &moves))
+        return false;
+    program->Reset(cube_num);
+    program->Append(moves);
+    return true;
+}
+
+}  // namespace rubiks
@@ -0,0 +1,442 @@
+#include "optimal_solver.hpp"
+#include <algorithm>
+#include <cstdint>
+#include "coordinates.hpp"
+
+namespace rubiks {
+
+const int OptimalSolver::TABLE_NUM;
+
+namespace {
+
+// Increase it when the layout of the tables changes.
+const uint32_t OPTIMAL_TABLE_VERSION = 2;
+
+// Classes of the sorted slice with flip and twist
+class Phase1Space : public StateSpace {
+ private:
+    const Phase1Symmetry& m_sym;
+    const uint16_t* m_twist_move;
+    const uint16_t* m_flip_move;
+    const uint16_t* m_slice_sorted_move;
+
+ public:
+    Phase1Space(const Phase1Symmetry& sym, const uint16_t* twist_move,
+                const uint16_t* flip_move, const uint16_t* slice_sorted_move)
+        : m_sym(sym), m_twist_move(twist_move), m_flip_move(flip_move),
+          m_slice_sorted_move(slice_sorted_move) {}
+
+    uint64_t Size() const
+    {
+        return m_sym.Size();
+    }
+
+    int MoveNum() const
+    {
+        return FACE_TURN_NUM;
+    }
+
+    void Neighbors(uint64_t index, uint64_t* neighbors) const
+    {
+        int twist = int(index % coord::CORNER_ORI_NUM);
+        index /= coord::CORNER_ORI_NUM;
+        int flip = int(index % coord::EDGE_ORI_NUM);
+        int slice_sorted = m_sym.class_rep[index / coord::EDGE_ORI_NUM];
+        for (int m = 0; m < FACE_TURN_NUM; m++) {
+            neighbors[m] = m_sym.Index(m_twist_move[twist * FACE_TURN_NUM + m],
+                                       m_flip_move[flip * FACE_TURN_NUM + m],
+                                       m_slice_sorted_move[slice_sorted * FACE_TURN_NUM + m]);
+        }
+    }
+};
+
+// Lower bound from the phase 1 distances along the 3 axes.
+// A shortest phase 1 solution along an axis never ends with a turn of that axis,
+// and the last move of a solution turns one of them.
+// So when all 3 distances are the same d > 0, the cube needs at least d + 1 moves (Kociemba).
+int AxisBound(const int* d)
+{
+    int h = std::max(d[0], std::max(d[1], d[2]));
+    if (h > 0 && d[0] == d[1] && d[1] == d[2])
+        h++;
+    return h;
+}
+
+}  // namespace
+
+const int Phase1Symmetry::FLIP_BITS_NUM;
+
+void Phase1Symmetry::Build(const Symmetries& syms)
+{
+    slice_class.assign(coord::SLICE_SORTED_NUM, UINT16_MAX);
+    slice_sym.assign(coord::SLICE_SORTED_NUM, 0);
+    slice_mask.resize(coord::SLICE_SORTED_NUM);
+    class_rep.clear();
+    class_syms.clear();
+    for (int rep = 0; rep < coord::SLICE_SORTED_NUM; rep++) {
+        CubieCube c;
+        coord::SetSliceSorted(&c, rep);
+        slice_mask[rep] = 0;
+        for (int i = 0; i < 12; i++) {
+            if (c.EdgePerm(i) >= FR)
+                slice_mask[rep] = uint16_t(slice_mask[rep] | (1 << i));
+        }
+        if (slice_class[rep] != UINT16_MAX)
+            continue;
+        uint16_t cls = uint16_t(class_rep.size());
+        uint16_t self_syms = 0;
+        for (int s = 0; s < UD_SYM_NUM; s++) {
+            CubieCube conj;
+            syms.Conjugate(c, s, &conj);
+            int slice_sorted = coord::GetSliceSorted(conj);
+            if (slice_sorted == rep)
+                self_syms = uint16_t(self_syms | (1 << s));
+            if (slice_class[slice_sorted] == UINT16_MAX) {
+                slice_class[slice_sorted] = cls;
+                slice_sym[slice_sorted] = uint8_t(syms.inverse[s]);
+            }
+        }
+        class_rep.push_back(uint16_t(rep));
+        class_syms.push_back(self_syms);
+    }
+
+    twist_conj.resize(coord::CORNER_ORI_NUM * UD_SYM_NUM);
+    for (int t = 0; t < coord::CORNER_ORI_NUM; t++) {
+        CubieCube c;
+        coord::SetCornerOri(&c, t);
+        for (int s = 0; s < UD_SYM_NUM; s++) {
+            CubieCube conj;
+            syms.Conjugate(c, s, &conj);
+            twist_conj[t * UD_SYM_NUM + s] = uint16_t(coord::GetCornerOri(conj));
+        }
+    }
+
+    // Edge i of S^-1 * c * S comes from position EdgePerm(i) of S, and its orientation
+    // adds the orientations of S at i and of S^-1 at the edge there.
+    // Symmetries keeping the U-D axis add the same orientation to all middle layer edges
+    // and to all other edges.
+    flip_bits.resize(coord::EDGE_ORI_NUM);
+    for (int f = 0; f < coord::EDGE_ORI_NUM; f++) {
+        CubieCube c;
+        coord::SetEdgeOri(&c, f);
+        flip_bits[f] = 0;
+        for (int i = 0; i < 12; i++)
+            flip_bits[f] = uint16_t(flip_bits[f] | (c.EdgeOri(i) << i));
+    }
+    flip_conj.resize(UD_SYM_NUM * FLIP_BITS_NUM);
+    for (int s = 0; s < UD_SYM_NUM; s++) {
+        const CubieCube& sym = syms.cubes[s];
+        const CubieCube& inverse = syms.cubes[syms.inverse[s]];
+        middle_flip[s] = uint16_t(inverse.EdgeOri(FR) ? FLIP_BITS_NUM - 1 : 0);
+        other_flip[s] = uint16_t(inverse.EdgeOri(UR) ? FLIP_BITS_NUM - 1 : 0);
+        for (int bits = 0; bits < FLIP_BITS_NUM; bits++) {
+            int flip = 0;
+            for (int i = 0; i < 11; i++)
+                flip = flip * 2 + ((bits >> sym.EdgePerm(i) & 1) ^ sym.EdgeOri(i));
+            flip_conj[s * FLIP_BITS_NUM + bits] = uint16_t(flip);
+        }
+    }
+}
+
+OptimalSolver::OptimalSolver(int thread_num)
+    : m_initialized(false), m_pool(thread_num), m_found_task(0),
+      m_cancel(false), m_node_count(0)
+{
+    m_workers.resize(m_pool.ThreadNum());
+}
+
+bool OptimalSolver::Initialize(const std::string& cache_path, const TableProgress& progress)
+{
+    if (m_initialized)
+        return true;
+
+    BuildFaceTurnCubes(m_moves);
+
+    // Move tables for the phase 1 coordinates
+    int all_moves[FACE_TURN_NUM];
+    for (int m = 0; m < FACE_TURN_NUM; m++)
+        all_moves[m] = m;
+    coord::BuildMoveTable(m_moves, all_moves, FACE_TURN_NUM, coord::CORNER_ORI_NUM,
+                          coord::GetCornerOri, coord::SetCornerOri, &m_corner_ori_move);
+    coord::BuildMoveTable(m_moves, all_moves, FACE_TURN_NUM, coord::EDGE_ORI_NUM,
+                          coord::GetEdgeOri, coord::SetEdgeOri, &m_edge_ori_move);
+    coord::BuildMoveTable(m_moves, all_moves, FACE_TURN_NUM, coord::SLICE_SORTED_NUM,
+                          coord::GetSliceSorted, coord::SetSliceSorted, &m_slice_sorted_move);
+
+    // Move tables for corners and edges of the inverse cube.
+    // The cubie at position CornerPerm(i) or EdgePerm(i) moves to position i.
+    for (int m = 0; m < FACE_TURN_NUM; m++) {
+        for (int i = 0; i < 8; i++) {
+            int from = m_moves[m].CornerPerm(i);
+            int twist = m_moves[m].CornerOri(i);
+            for (int ori = 0; ori < 3; ori++)
+                m_corner_move[m][from | (ori << 3)] = uint8_t(i | ((ori + 3 - twist) % 3 << 3));
+        }
+        std::fill(m_edge_move[m], m_edge_move[m] + 32, 0);
+        for (int i = 0; i < 12; i++) {
+            int from = m_moves[m].EdgePerm(i);
+            int flip = m_moves[m].EdgeOri(i);
+            for (int ori = 0; ori < 2; ori++)
+                m_edge_move[m][from | (ori << 4)] = uint8_t(i | ((ori ^ flip) << 4));
+        }
+    }
+
+    // The cube along the R-L and F-B axes is conjugated by ROT_URF3 and ROT_URF3^2
+    m_syms.Build(m_moves);
+    for (int axis = 0; axis < 3; axis++) {
+        for (int m = 0; m < FACE_TURN_NUM; m++)
+            m_axis_moves[axis][m] = m_syms.moves[axis * SYM_URF3][m];
+    }
+    m_phase1_sym.Build(m_syms);
+
+    // Pattern database
+    TableFileInfo info;
+    info.name = "optimal";
+    info.version = OPTIMAL_TABLE_VERSION;
+    info.cube_num = 3;
+    info.metric = METRIC_FACE_TURN;
+    info.move_hash = Fnv1a(m_moves, sizeof(m_moves));
+    info.table_sizes.push_back(m_phase1_sym.Size());
+    PruningTable* tables[TABLE_NUM] = { &m_phase1_table };
+    if (!LoadTables(cache_path, info, &m_table_file, tables)) {
+        CubieCube solved;
+        Phase1Space phase1_space(m_phase1_sym, m_corner_ori_move.data(), m_edge_ori_move.data(),
+                                 m_slice_sorted_move.data());
+        const StateSpace* spaces[TABLE_NUM] = { &phase1_space };
+        uint64_t goals[TABLE_NUM] = {
+            m_phase1_sym.Index(coord::GetCornerOri(solved), coord::GetEdgeOri(solved),
+                               coord::GetSliceSorted(solved))
+        };
+        for (int i = 0; i < TABLE_NUM; i++) {
+            GenerateProgress table_progress;
+            if (progress) {
+                table_progress = [&progress, i](int depth, uint64_t visited, uint64_t size) {
+                    progress(i, TABLE_NUM, depth, visited, size);
+                };
+            }
+            if (tables[i]->Generate(*spaces[i], goals[i], m_pool.ThreadNum(),
+                                    table_progress, &m_cancel) < 0) {
+                m_cancel = false;
+                return false;
+            }
+        }
+
+        // Map the saved file to share its pages with other processes
+        if (!cache_path.empty() && SaveTables(cache_path, info, tables))
+            LoadTables(cache_path, info, &m_table_file, tables);
+    }
+
+    m_initialized = true;
+    return true;
+}
+
+void OptimalSolver::ApplyMove(const Node& node, int move, Node* child) const
+{
+    const uint8_t* corner_move = m_corner_move[move];
+    for (int i = 0; i < 8; i++)
+        child->corners[i] = corner_move[node.corners[i]];
+    const uint8_t* edge_move = m_edge_move[move];
+    for (int i = 0; i < 12; i++)
+        child->edges[i] = edge_move[node.edges[i]];
+    for (int axis = 0; axis < 3; axis++) {
+        int m = m_axis_moves[axis][move];
+        child->twist[axis] = m_corner_ori_move[node.twist[axis] * FACE_TURN_NUM + m];
+        child->flip[axis] = m_edge_ori_move[node.flip[axis] * FACE_TURN_NUM + m];
+        child->slice_sorted[axis] =
+            m_slice_sorted_move[node.slice_sorted[axis] * FACE_TURN_NUM + m];
+    }
+}
+
+int OptimalSolver::Heuristic(const Node& node, int limit) const
+{
+    // Each lookup is likely a cache miss.
+    // Stop as soon as a distance exceeds the limit.
+    int d[3];
+    for (int axis = 0; axis < 3; axis++) {
+        uint64_t index = m_phase1_sym.Index(node.twist[axis], node.flip[axis],
+                                            node.slice_sorted[axis]);
+        d[axis] = m_phase1_table.Get(index);
+        if (d[axis] > limit)
+            return d[axis];
+    }
+    int h = AxisBound(d);
+    if (h > limit)
+        return h;
+
+    // The inverse of a solution solves the inverse cube, so its distances are lower bounds too.
+    // Its coordinates are only computed for the few nodes that get here.
+    CubieCube inverse;
+    std::copy(node.corners, node.corners + 8, inverse.corners);
+    std::copy(node.edges, node.edges + 12, inverse.edges);
+    for (int axis = 0; axis < 3; axis++) {
+        CubieCube c = inverse;
+        if (axis > 0)
+            m_syms.Conjugate(inverse, axis * SYM_URF3, &c);
+        uint64_t index = m_phase1_sym.Index(coord::GetCornerOri(c), coord::GetEdgeOri(c),
+                                            coord::GetSliceSorted(c));
+        d[axis] = m_phase1_table.Get(index);
+        if (d[axis] > limit)
+            return d[axis];
+    }
+    return std::max(h, AxisBound(d));
+}
+
+bool OptimalSolver::IsSolved(const Node& node) const
+{
+    // A zero heuristic leaves corners that swapped places without twisting along any axis
+    CubieCube solved;
+    return std::equal(node.corners, node.corners + 8, solved.corners) &&
+           std::equal(node.edges, node.edges + 12, solved.edges);
+}
+
+bool OptimalSolver::Search(const Node& node, int depth, int bound, int last_face,
+                           size_t task, Worker* worker)
+{
+    // Give up when an earlier subtree has a solution
+    if (m_cancel.load(std::memory_order_relaxed) ||
+        m_found_task.load(std::memory_order_relaxed) < task)
+        return false;
+
+    // Make all children first and prefetch their table entries,
+    // so that the cache misses of their lookups overlap.
+    Node children[FACE_TURN_NUM];
+    int moves[FACE_TURN_NUM];
+    int child_num = 0;
+    for (int face = 0; face < 6; face++) {
+        // Skip turning the same face twice in a row.
+        // Opposite faces commute, so they are only searched in one order.
+        if (face == last_face || face + 3 == last_face)
+            continue;
+        for (int turns = 1; turns <= 3; turns++) {
+            Node& child = children[child_num];
+            int move = FaceTurn(face, turns);
+            moves[child_num++] = move;
+            ApplyMove(node, move, &child);
+            for (int axis = 0; axis < 3; axis++) {
+                m_phase1_table.Prefetch(m_phase1_sym.Index(child.twist[axis], child.flip[axis],
+                                                           child.slice_sorted[axis]));
+            }
+        }
+    }
+
+    for (int i = 0; i < child_num; i++) {
+        const Node& child = children[i];
+        worker->node_count++;
+        int h = Heuristic(child, bound - depth - 1);
+        if (depth + 1 + h > bound)
+            continue;
+        worker->path[depth] = moves[i];
+        if (h == 0 && IsSolved(child)) {
+            worker->path.resize(depth + 1);
+            return true;
+        }
+        if (Search(child, depth + 1, bound, moves[i] / 3, task, worker))
+            return true;
+    }
+    return false;
+}
+
+void OptimalSolver::MakeTasks(const Node& root, int bound)
+{
+    // Same order and pruning as Search()
+    m_tasks.clear();
+    for (int face1 = 0; face1 < 6; face1++) {
+        for (int turns1 = 1; turns1 <= 3; turns1++) {
+            Task task;
+            task.moves[0] = FaceTurn(face1, turns1);
+            Node child;
+            ApplyMove(root, task.moves[0], &child);
+            if (1 + Heuristic(child, bound - 1) > bound)
+                continue;
+            for (int face2 = 0; face2 < 6; face2++) {
+                if (face2 == face1 || face2 + 3 == face1)
+                    continue;
+                for (int turns2 = 1; turns2 <= 3; turns2++) {
+                    task.moves[1] = FaceTurn(face2, turns2);
+                    ApplyMove(child, task.moves[1], &task.node);
+                    if (2 + Heuristic(task.node, bound - 2) <= bound)
+                        m_tasks.push_back(task);
+                }
+            }
+        }
+    }
+}
+
+void OptimalSolver::RunTask(size_t task, int bound, Worker* worker)
+{
+    const Task& t = m_tasks[task];
+    worker->path.assign(bound, -1);
+    worker->path[0] = t.moves[0];
+    worker->path[1] = t.moves[1];
+    if (!Search(t.node, 2, bound, t.moves[1] / 3, task, worker))
+        return;
+
+    m_task_solutions[task] = worker->path;
+    size_t found = m_found_task.load();
+    while (task < found && !m_found_task.compare_exchange_weak(found, task)) {}
+}
+
+bool OptimalSolver::Solve(const CubieCube& cube, std::vector<int>* solution, int max_length)
+{
+    m_node_count = 0;
+    solution->clear();
+    if (!cube.IsValid()) {
+        m_cancel = false;
+        return false;
+    }
+    if (!Initialize())
+        return false;
+
+    Node root;
+    CubieCube inverse = cube.Inverse();
+    std::copy(inverse.corners, inverse.corners + 8, root.corners);
+    std::copy(inverse.edges, inverse.edges + 12, root.edges);
+    for (int axis = 0; axis < 3; axis++) {
+        CubieCube c;
+        m_syms.Conjugate(cube, axis * SYM_URF3, &c);
+        root.twist[axis] = uint16_t(coord::GetCornerOri(c));
+        root.flip[axis] = uint16_t(coord::GetEdgeOri(c));
+        root.slice_sorted[axis] = uint16_t(coord::GetSliceSorted(c));
+    }
+
+    for (Worker& w : m_workers)
+        w.node_count = 0;
+    bool found = false;
+    int h = Heuristic(root, max_length);
+    if (h == 0 && IsSolved(root))
+        found = true;
+
+    for (int bound = h; bound <= max_length && !found && !m_cancel; bound++) {
+        Worker& w = m_workers[0];
+        m_found_task = SIZE_MAX;
+        if (bound <= 2) {
+            // Too short to split
+            w.path.assign(bound, -1);
+            found = Search(root, 0, bound, -1, 0, &w);
+            if (found)
+                *solution = w.path;
+            continue;
+        }
+
+        // Search subtrees under the first 2 moves in parallel
+        MakeTasks(root, bound);
+        m_task_solutions.assign(m_tasks.size(), std::vector<int>());
+        m_pool.ParallelFor(m_tasks.size(), [&](size_t task, int worker) {
+            RunTask(task, bound, &m_workers[worker]);
+        });
+        size_t task = m_found_task;
+        found = task != SIZE_MAX && !m_cancel;
+        if (found)
+            *solution = m_task_solutions[task];
+    }
+
+    for (const Worker& w : m_workers)
+        m_node_count += w.node_count;
+    found = found && !m_cancel;
+    m_cancel = false;
+    if (!found)
+        solution->clear();
+    return found;
+}
+
+}  // namespace rubiks
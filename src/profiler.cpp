@@ -0,0 +1,147 @@
+#include "profiler.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+namespace rubiks {
+
+namespace {
+
+// Sample at a fraction of sorted samples
+double Percentile(const std::vector<double>& sorted, double fraction)
+{
+    size_t i = size_t(fraction * double(sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+}  // namespace
+
+Profiler::Profiler() : m_event_count(0), m_origin(Now())
+{
+    // Recording doesn't allocate, so it doesn't disturb allocation budgets.
+    m_events.reserve(MAX_TRACE_EVENTS);
+}
+
+Profiler& Profiler::Get()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+double Profiler::Now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+int Profiler::StageId(const char* name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = 0; i < m_stages.size(); i++) {
+        if (strcmp(m_stages[i].name, name) == 0)
+            return int(i);
+    }
+    Stage stage;
+    stage.name = name;
+    stage.count = 0;
+    m_stages.push_back(stage);
+    m_stages.back().samples.reserve(WINDOW_SIZE);
+    return int(m_stages.size() - 1);
+}
+
+void Profiler::Record(int stage, double start, double end)
+{
+    std::thread::id thread_id = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stage& s = m_stages[stage];
+    double duration = end - start;
+    if (s.samples.size() < WINDOW_SIZE)
+        s.samples.push_back(duration);
+    else
+        s.samples[s.count % WINDOW_SIZE] = duration;
+    s.count++;
+
+    int thread = 0;
+    while (thread < int(m_threads.size()) && m_threads[thread] != thread_id)
+        thread++;
+    if (thread == int(m_threads.size()))
+        m_threads.push_back(thread_id);
+
+    TraceEvent event = { stage, thread, start - m_origin, duration };
+    if (m_events.size() < MAX_TRACE_EVENTS)
+        m_events.push_back(event);
+    else
+        m_events[m_event_count % MAX_TRACE_EVENTS] = event;
+    m_event_count++;
+}
+
+void Profiler::GetStats(std::vector<StageStats>* stats)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats->clear();
+    std::vector<double> sorted;
+    for (const Stage& s : m_stages) {
+        if (s.samples.empty())
+            continue;
+        sorted = s.samples;
+        std::sort(sorted.begin(), sorted.end());
+        StageStats st;
+        st.name = s.name;
+        st.count = s.count;
+        st.p50 = Percentile(sorted, 0.50);
+        st.p95 = Percentile(sorted, 0.95);
+        st.p99 = Percentile(sorted, 0.99);
+        st.max = sorted.back();
+        stats->push_back(st);
+    }
+}
+
+std::string Profiler::FormatStats()
+{
+    std::vector<StageStats> stats;
+    GetStats(&stats);
+    std::string text = "stage            p50 ms   p95 ms   p99 ms\n";
+    char line[128];
+    for (const StageStats& st : stats) {
+        snprintf(line, sizeof(line), "%-14s %8.3f %8.3f %8.3f\n",
+                 st.name, st.p50 * 1e3, st.p95 * 1e3, st.p99 * 1e3);
+        text += line;
+    }
+    return text;
+}
+
+bool Profiler::WriteTrace(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Complete events ("ph": "X") in microseconds, from the oldest
+    fprintf(file, "{\"traceEvents\":[\n");
+    size_t n = m_events.size();
+    size_t first = (m_event_count > n) ? m_event_count % n : 0;
+    for (size_t i = 0; i < n; i++) {
+        const TraceEvent& e = m_events[(first + i) % n];
+        fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                "\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                m_stages[e.stage].name, e.thread, e.start * 1e6, e.duration * 1e6,
+                (i + 1 < n) ? "," : "");
+    }
+    fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+    return fclose(file) == 0;
+}
+
+void Profiler::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (Stage& s : m_stages) {
+        s.samples.clear();
+        s.count = 0;
+    }
+    m_events.clear();
+    m_event_count = 0;
+}
+
+}  // namespace rubiks
@@ -0,0 +1,183 @@
+#include "pruning_table.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include "thread_pool.hpp"
+
+namespace rubiks {
+
+namespace {
+
+// Entries are packed into 32 bit words during generation, so threads can update them atomically.
+typedef std::atomic<uint32_t> Word;
+
+const int WORD_ENTRIES = 8;
+const uint64_t CHUNK_SIZE = 1 << 16;  // states per chunk (multiple of WORD_ENTRIES)
+// 64 MiB. Blocks over the largest mmap threshold of glibc (32 MiB) are mapped one by one,
+// so freeing a block gives its memory back to the system.
+const uint64_t BLOCK_WORDS = 1 << 24;
+
+// Words are allocated in blocks, so they can be packed into bytes and freed one block at a time.
+// Then large tables never have two copies in memory.
+class WordTable {
+ private:
+    std::vector<std::unique_ptr<Word[]>> m_blocks;
+
+ public:
+    explicit WordTable(uint64_t size)
+    {
+        uint64_t word_num = (size + WORD_ENTRIES - 1) / WORD_ENTRIES;
+        for (uint64_t begin = 0; begin < word_num; begin += BLOCK_WORDS) {
+            uint64_t n = std::min(BLOCK_WORDS, word_num - begin);
+            m_blocks.emplace_back(new Word[n]);
+            for (uint64_t i = 0; i < n; i++)
+                m_blocks.back()[i].store(0xFFFFFFFF, std::memory_order_relaxed);
+        }
+    }
+
+    Word& operator[](uint64_t i) const
+    {
+        return m_blocks[i / BLOCK_WORDS][i % BLOCK_WORDS];
+    }
+
+    // Append the bytes of all words to data, freeing each block after it's copied
+    void MoveTo(std::vector<uint8_t>* data, size_t byte_num)
+    {
+        data->clear();
+        data->reserve(byte_num);
+        for (std::unique_ptr<Word[]>& block : m_blocks) {
+            for (uint64_t i = 0; i < BLOCK_WORDS && data->size() < byte_num; i++) {
+                uint32_t word = block[i].load(std::memory_order_relaxed);
+                for (int b = 0; b < 4 && data->size() < byte_num; b++)
+                    data->push_back(uint8_t(word >> (b * 8)));
+            }
+            block.reset();
+        }
+    }
+};
+
+inline int GetEntry(const WordTable& words, uint64_t index)
+{
+    uint32_t word = words[index / WORD_ENTRIES].load(std::memory_order_relaxed);
+    return (word >> ((index % WORD_ENTRIES) * 4)) & 15;
+}
+
+// Change an unknown entry to depth, and return true if this call changed it.
+// The only other change made at the same time is the same one,
+// so clearing bits never breaks a known entry.
+inline bool SetUnknownEntry(const WordTable& words, uint64_t index, int depth)
+{
+    int shift = int(index % WORD_ENTRIES) * 4;
+    uint32_t mask = uint32_t(PruningTable::UNKNOWN ^ depth) << shift;
+    uint32_t old = words[index / WORD_ENTRIES].fetch_and(~mask, std::memory_order_relaxed);
+    return ((old >> shift) & 15) == PruningTable::UNKNOWN;
+}
+
+// One depth of breadth-first search on a chunk of states
+uint64_t SearchChunk(const StateSpace& space, const WordTable& words, int depth, bool backward,
+                     uint64_t begin, uint64_t end, uint64_t* neighbors)
+{
+    int move_num = space.MoveNum();
+    uint64_t found = 0;
+    for (uint64_t i = begin; i < end; i++) {
+        int d = GetEntry(words, i);
+        if (!backward && d == depth) {
+            space.Neighbors(i, neighbors);
+            for (int m = 0; m < move_num; m++) {
+                if (GetEntry(words, neighbors[m]) == PruningTable::UNKNOWN &&
+                    SetUnknownEntry(words, neighbors[m], depth + 1))
+                    found++;
+            }
+        } else if (backward && d == PruningTable::UNKNOWN) {
+            space.Neighbors(i, neighbors);
+            for (int m = 0; m < move_num; m++) {
+                if (GetEntry(words, neighbors[m]) == depth) {
+                    SetUnknownEntry(words, i, depth + 1);
+                    found++;
+                    break;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+}  // namespace
+
+void PruningTable::Allocate(uint64_t size)
+{
+    m_size = size;
+    m_data.assign(size_t((size + 1) / 2), 0xFF);
+    m_view = m_data.data();
+}
+
+void PruningTable::Attach(const uint8_t* data, uint64_t size)
+{
+    std::vector<uint8_t>().swap(m_data);
+    m_size = size;
+    m_view = data;
+}
+
+int PruningTable::Generate(const StateSpace& space, uint64_t goal, int thread_num,
+                           const GenerateProgress& progress, const std::atomic<bool>* cancel)
+{
+    uint64_t size = space.Size();
+    uint64_t chunk_num = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    if (thread_num <= 0)
+        thread_num = std::max(1, int(std::thread::hardware_concurrency()));
+    ThreadPool pool(int(std::min(uint64_t(thread_num), chunk_num)));
+
+    WordTable words(size);
+    SetUnknownEntry(words, goal, 0);
+
+    int move_num = space.MoveNum();
+    std::vector<uint64_t> neighbors(size_t(pool.ThreadNum()) * move_num);
+    std::vector<uint64_t> found(pool.ThreadNum());
+    uint64_t visited = 1;
+    uint64_t frontier = 1;
+    int depth = 0;
+    if (progress)
+        progress(depth, visited, size);
+
+    while (visited < size && depth < UNKNOWN - 1) {
+        // Expand the frontier while it's small.
+        // When most states are visited, check unknown states
+        // whether they have a neighbor in the frontier instead.
+        bool backward = frontier > size - visited;
+        std::fill(found.begin(), found.end(), 0);
+        pool.ParallelFor(size_t(chunk_num), [&](size_t chunk, int worker) {
+            if (cancel && cancel->load(std::memory_order_relaxed))
+                return;
+            uint64_t begin = chunk * CHUNK_SIZE;
+            found[worker] += SearchChunk(space, words, depth, backward,
+                                         begin, std::min(begin + CHUNK_SIZE, size),
+                                         neighbors.data() + worker * move_num);
+        });
+
+        if (cancel && cancel->load()) {
+            std::vector<uint8_t>().swap(m_data);
+            m_view = nullptr;
+            m_size = 0;
+            return -1;
+        }
+
+        uint64_t found_num = 0;
+        for (uint64_t f : found)
+            found_num += f;
+        if (found_num == 0)
+            break;
+        visited += found_num;
+        frontier = found_num;
+        depth++;
+        if (progress)
+            progress(depth, visited, size);
+    }
+
+    // Pack words into bytes of 2 entries
+    m_size = size;
+    words.MoveTo(&m_data, size_t((size + 1) / 2));
+    m_view = m_data.data();
+    return depth;
+}
+
+}  // namespace rubiks
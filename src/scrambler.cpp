@@ -0,0 +1,147 @@
+#include "scrambler.hpp"
+#include <algorithm>
+#include <atomic>
+#include "coordinates.hpp"
+
+namespace rubiks {
+
+Scrambler::Scrambler(int cube_num, ScrambleType type, const TwoPhaseTables* tables) :
+    m_rng(), m_cube_num(cube_num), m_type(type), m_move_num(DEFAULT_SCRAMBLE_MOVES),
+    m_solver(tables), m_has_tables(tables != nullptr && tables->built) {}
+
+void Scrambler::Seed(uint32_t seed)
+{
+    m_rng.seed(seed);
+}
+
+void Scrambler::Seed(uint32_t seed, uint64_t index)
+{
+    std::seed_seq seq = { seed, uint32_t(index), uint32_t(index >> 32) };
+    m_rng.seed(seq);
+}
+
+uint32_t Scrambler::Below(uint32_t n)
+{
+    // Reject the top values that would make some results more likely
+    uint32_t threshold = uint32_t(0 - n) % n;
+    while (true) {
+        uint32_t r = uint32_t(m_rng());
+        if (r >= threshold)
+            return r % n;
+    }
+}
+
+bool Scrambler::Generate(std::vector<NotationMove>* scramble, double timeout)
+{
+    if (m_type == SCRAMBLE_RANDOM_STATE)
+        return RandomState(scramble, timeout);
+    RandomMoves(scramble);
+    return true;
+}
+
+void Scrambler::RandomMoves(std::vector<NotationMove>* scramble)
+{
+    scramble->clear();
+    int n = m_cube_num;
+    int last_axis = 0;
+    int last_layer = -1;
+    for (int i = 0; i < m_move_num; i++) {
+        // Layers of the other axes, and later layers of the last axis
+        int same_axis_num = last_axis ? n - 1 - last_layer : n;
+        int choice = int(Below(uint32_t(same_axis_num + 2 * n)));
+        int axis, layer;
+        if (!last_axis) {
+            axis = choice / n + 1;
+            layer = choice % n;
+        } else if (choice < same_axis_num) {
+            axis = last_axis;
+            layer = last_layer + 1 + choice;
+        } else {
+            choice -= same_axis_num;
+            axis = (last_axis + choice / n) % 3 + 1;  // the next two axes
+            layer = choice % n;
+        }
+        int degree = int(Below(3)) + DEGREE_90;
+        scramble->push_back(LayerMoveToNotation(n, axis, layer, degree));
+        last_axis = axis;
+        last_layer = layer;
+    }
+}
+
+CubieCube Scrambler::RandomCube()
+{
+    // Shuffle pieces, counting swaps for the parity
+    int corners[8];
+    int edges[12];
+    int parity = 0;
+    for (int i = 0; i < 8; i++)
+        corners[i] = i;
+    for (int i = 7; i > 0; i--) {
+        int j = int(Below(uint32_t(i + 1)));
+        if (j != i) {
+            std::swap(corners[i], corners[j]);
+            parity ^= 1;
+        }
+    }
+    for (int i = 0; i < 12; i++)
+        edges[i] = i;
+    for (int i = 11; i > 0; i--) {
+        int j = int(Below(uint32_t(i + 1)));
+        if (j != i) {
+            std::swap(edges[i], edges[j]);
+            parity ^= 1;
+        }
+    }
+    // Corners and edges should have the same parity.
+    // Swapping two edges pairs each unsolvable state with one solvable state.
+    if (parity)
+        std::swap(edges[10], edges[11]);
+
+    CubieCube cube;
+    for (int i = 0; i < 8; i++)
+        cube.SetCorner(i, corners[i], 0);
+    for (int i = 0; i < 12; i++)
+        cube.SetEdge(i, edges[i], 0);
+    coord::SetCornerOri(&cube, int(Below(coord::CORNER_ORI_NUM)));
+    coord::SetEdgeOri(&cube, int(Below(coord::EDGE_ORI_NUM)));
+    return cube;
+}
+
+bool Scrambler::RandomState(std::vector<NotationMove>* scramble, double timeout)
+{
+    scramble->clear();
+    if (m_cube_num != 3 || !m_has_tables)
+        return false;
+    CubieCube cube = RandomCube();
+    if (!m_solver.Solve(cube, &m_solution, 21, timeout))
+        return false;
+    InvertSolution(m_solution, scramble);
+    return true;
+}
+
+void InvertSolution(const std::vector<int>& solution, std::vector<NotationMove>* scramble)
+{
+    scramble->clear();
+    for (size_t i = solution.size(); i > 0; i--) {
+        int move = solution[i - 1];
+        NotationMove inverse = { NOTATION_FACE_NAMES[move / 3], 0, false, 3 - move % 3 };
+        scramble->push_back(inverse);
+    }
+}
+
+bool GenerateScrambles(ThreadPool* pool, const Scrambler& scrambler, uint32_t seed,
+                       size_t count, std::vector<std::vector<NotationMove>>* scrambles)
+{
+    scrambles->resize(count);
+    std::vector<Scrambler> workers(size_t(pool->ThreadNum()), scrambler);
+    std::atomic<bool> ok(true);
+    pool->ParallelFor(count, [&](size_t task, int worker) {
+        Scrambler& s = workers[size_t(worker)];
+        s.Seed(seed, task);
+        if (!s.Generate(&(*scrambles)[task]))
+            ok.store(false, std::memory_order_relaxed);
+    });
+    return ok.load();
+}
+
+}  // namespace rubiks
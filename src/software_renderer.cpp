@@ -0,0 +1,237 @@
+#include "software_renderer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "profiler.hpp"
+#include "rubiks.hpp"
+
+namespace rubiks {
+
+namespace {
+
+const float FAR_DEPTH = std::numeric_limits<float>::infinity();
+
+// First pixel whose center is at or after pos, clamped to [0, size]
+inline int PixelBegin(double pos, int size)
+{
+    double p = std::ceil(pos - 0.5);
+    return int(std::min(double(size), std::max(0.0, p)));
+}
+
+}  // namespace
+
+SoftwareRenderer::SoftwareRenderer(int width, int height, int thread_num)
+    : m_fill_span(simd::GetFillSpan(simd::BestSpanKernel())), m_background(0), m_cleared(false),
+      m_clear_all(true), m_depth_test(false), m_tile_columns(0), m_pool(new ThreadPool(thread_num))
+{
+    Resize(width, height);
+}
+
+void SoftwareRenderer::Resize(int width, int height)
+{
+    m_framebuffer.Resize(width, height);
+    if (m_depth_test)
+        m_depth.resize(m_framebuffer.pixels.size());
+    m_cleared = false;
+    m_scale = std::min(width, height) / VIEW_SIZE;
+    m_offset_x = (width - VIEW_SIZE * m_scale) * 0.5;
+    m_offset_y = (height - VIEW_SIZE * m_scale) * 0.5;
+
+    m_tile_columns = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+    int tile_rows = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    m_tiles.resize(size_t(m_tile_columns) * size_t(tile_rows));
+    for (int ty = 0; ty < tile_rows; ty++) {
+        for (int tx = 0; tx < m_tile_columns; tx++) {
+            Tile& tile = m_tiles[ty * m_tile_columns + tx];
+            tile.rect.left = tx * TILE_WIDTH;
+            tile.rect.top = ty * TILE_HEIGHT;
+            tile.rect.right = std::min(width, tile.rect.left + TILE_WIDTH);
+            tile.rect.bottom = std::min(height, tile.rect.top + TILE_HEIGHT);
+        }
+    }
+}
+
+bool SoftwareRenderer::SetSpanKernel(simd::SpanKernel kernel)
+{
+    simd::FillSpanFunc func = simd::GetFillSpan(kernel);
+    if (!func)
+        return false;
+    m_fill_span = func;
+    return true;
+}
+
+void SoftwareRenderer::SetDepthTest(bool enable)
+{
+    m_depth_test = enable;
+    if (enable)
+        m_depth.resize(m_framebuffer.pixels.size());
+    else
+        std::vector<float>().swap(m_depth);
+    m_cleared = false;
+}
+
+void SoftwareRenderer::BinFaces(const FrameContext& frame)
+{
+    RUBIKS_PROFILE_SCOPE("Render.Bin");
+    for (Tile& tile : m_tiles)
+        tile.faces.clear();
+    m_quads.resize(frame.visible_face_count);
+
+    int width = m_framebuffer.width;
+    int height = m_framebuffer.height;
+    const VertexArray& vertices = frame.projected_vertices;
+    for (size_t i = 0; i < frame.visible_face_count; i++) {
+        const Quad& face = frame.visible_faces[i];
+        const int ids[4] = { face.v1, face.v2, face.v3, face.v4 };
+        double xs[4];
+        double ys[4];
+        double zs[4];
+        for (int k = 0; k < 4; k++) {
+            xs[k] = vertices.x[ids[k]] * m_scale + m_offset_x;
+            ys[k] = vertices.y[ids[k]] * m_scale + m_offset_y;
+            zs[k] = vertices.z[ids[k]];
+        }
+
+        // Edges are oriented downward, so shared edges give the same x on both faces
+        ScreenQuad& quad = m_quads[i];
+        quad.edge_num = 0;
+        quad.pixel = PackPixel(face.color);
+        for (int k = 0; k < 4; k++) {
+            int a = k;
+            int b = (k + 1) % 4;
+            if (ys[a] == ys[b])
+                continue;
+            if (ys[a] > ys[b])
+                std::swap(a, b);
+            Edge& e = quad.edges[quad.edge_num++];
+            e.y_top = ys[a];
+            e.y_bottom = ys[b];
+            e.x_top = xs[a];
+            e.slope = (xs[b] - xs[a]) / (ys[b] - ys[a]);
+        }
+
+        // The projection is orthographic, so depth is linear in x and y on a face.
+        // Get the plane of the first 3 vertices from their cross product.
+        double ax = xs[1] - xs[0], ay = ys[1] - ys[0], az = zs[1] - zs[0];
+        double bx = xs[2] - xs[0], by = ys[2] - ys[0], bz = zs[2] - zs[0];
+        double nx = ay * bz - az * by;
+        double ny = az * bx - ax * bz;
+        double nz = ax * by - ay * bx;
+        quad.dzdx = (nz != 0) ? -nx / nz : 0;
+        quad.dzdy = (nz != 0) ? -ny / nz : 0;
+        quad.z_base = zs[0] - quad.dzdx * xs[0] - quad.dzdy * ys[0];
+
+        // Pixels the quad can cover
+        int x_begin = PixelBegin(*std::min_element(xs, xs + 4), width);
+        int x_end = PixelBegin(*std::max_element(xs, xs + 4), width);
+        int y_begin = PixelBegin(*std::min_element(ys, ys + 4), height);
+        int y_end = PixelBegin(*std::max_element(ys, ys + 4), height);
+        if (x_begin >= x_end || y_begin >= y_end)
+            continue;
+        for (int ty = y_begin / TILE_HEIGHT; ty <= (y_end - 1) / TILE_HEIGHT; ty++) {
+            for (int tx = x_begin / TILE_WIDTH; tx <= (x_end - 1) / TILE_WIDTH; tx++)
+                m_tiles[ty * m_tile_columns + tx].faces.push_back(uint32_t(i));
+        }
+    }
+}
+
+void SoftwareRenderer::FillSpanDepth(const ScreenQuad& quad, int x_begin, int x_end, int y)
+{
+    size_t offset = size_t(y) * size_t(m_framebuffer.width);
+    uint32_t* row = m_framebuffer.pixels.data() + offset;
+    float* depth = m_depth.data() + offset;
+    double row_z = quad.z_base + quad.dzdy * (y + 0.5);
+    for (int x = x_begin; x < x_end; x++) {
+        float z = float(row_z + quad.dzdx * (x + 0.5));
+        if (z < depth[x]) {
+            depth[x] = z;
+            row[x] = quad.pixel;
+        }
+    }
+}
+
+void SoftwareRenderer::FillQuad(const ScreenQuad& quad, Tile& tile)
+{
+    double min_y = quad.edges[0].y_top;
+    double max_y = quad.edges[0].y_bottom;
+    for (int i = 1; i < quad.edge_num; i++) {
+        min_y = std::min(min_y, quad.edges[i].y_top);
+        max_y = std::max(max_y, quad.edges[i].y_bottom);
+    }
+
+    int width = m_framebuffer.width;
+    int height = m_framebuffer.height;
+    int y_begin = std::max(tile.rect.top, PixelBegin(min_y, height));
+    int y_end = std::min(tile.rect.bottom, PixelBegin(max_y, height));
+    for (int y = y_begin; y < y_end; y++) {
+        double center_y = y + 0.5;
+        double left = 0;
+        double right = 0;
+        bool found = false;
+        for (int i = 0; i < quad.edge_num; i++) {
+            const Edge& e = quad.edges[i];
+            if (center_y < e.y_top || center_y >= e.y_bottom)
+                continue;
+            double x = e.x_top + (center_y - e.y_top) * e.slope;
+            if (!found) {
+                left = right = x;
+                found = true;
+            } else {
+                left = std::min(left, x);
+                right = std::max(right, x);
+            }
+        }
+        if (!found)
+            continue;
+        int x_begin = std::max(tile.rect.left, PixelBegin(left, width));
+        int x_end = std::min(tile.rect.right, PixelBegin(right, width));
+        if (x_begin < x_end) {
+            if (m_depth_test)
+                FillSpanDepth(quad, x_begin, x_end, y);
+            else
+                m_fill_span(m_framebuffer.Row(y) + x_begin, size_t(x_end - x_begin), quad.pixel);
+            tile.dirty.left = std::min(tile.dirty.left, x_begin);
+            tile.dirty.right = std::max(tile.dirty.right, x_end);
+            tile.dirty.top = std::min(tile.dirty.top, y);
+            tile.dirty.bottom = std::max(tile.dirty.bottom, y + 1);
+        }
+    }
+}
+
+void SoftwareRenderer::DrawTile(Tile& tile, uint32_t background)
+{
+    const Rect& clear = m_clear_all ? tile.rect : tile.dirty;
+    if (clear.left < clear.right) {
+        size_t width = size_t(clear.right - clear.left);
+        for (int y = clear.top; y < clear.bottom; y++) {
+            m_fill_span(m_framebuffer.Row(y) + clear.left, width, background);
+            if (m_depth_test) {
+                float* depth = m_depth.data() + size_t(y) * size_t(m_framebuffer.width) + clear.left;
+                std::fill(depth, depth + width, FAR_DEPTH);
+            }
+        }
+    }
+    tile.dirty.left = tile.rect.right;
+    tile.dirty.top = tile.rect.bottom;
+    tile.dirty.right = tile.rect.left;
+    tile.dirty.bottom = tile.rect.top;
+
+    for (uint32_t face : tile.faces)
+        FillQuad(m_quads[face], tile);
+}
+
+void SoftwareRenderer::DrawFrame(const FrameContext& frame, uint32_t background)
+{
+    RUBIKS_PROFILE_SCOPE("Render");
+    uint32_t pixel = PackPixel(background);
+    m_clear_all = !m_cleared || pixel != m_background;
+    m_background = pixel;
+    BinFaces(frame);
+    // Capture only this, so the task function fits in std::function without allocations
+    m_pool->ParallelFor(m_tiles.size(), [this](size_t tile, int /*worker*/) {
+        DrawTile(m_tiles[tile], m_background);
+    });
+    m_cleared = true;
+}
+
+}  // namespace rubiks
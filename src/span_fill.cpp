@@ -0,0 +1,179 @@
+#include "span_fill.hpp"
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define RUBIKS_SPAN_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define RUBIKS_SPAN_NEON
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang need the target attribute to compile AVX2 code without -mavx2.
+// MSVC compiles intrinsics of any instruction set.
+#if defined(RUBIKS_SPAN_X86) && (defined(__GNUC__) || defined(__clang__))
+#define RUBIKS_TARGET_AVX2 __attribute__((target("avx2")))
+#define RUBIKS_TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define RUBIKS_TARGET_AVX2
+#define RUBIKS_TARGET_SSE2
+#endif
+
+namespace simd {
+
+namespace {
+
+void FillSpanScalar(uint32_t* dst, size_t n, uint32_t pixel)
+{
+    for (size_t i = 0; i < n; i++)
+        dst[i] = pixel;
+}
+
+#ifdef RUBIKS_SPAN_X86
+
+RUBIKS_TARGET_SSE2
+void FillSpanSSE2(uint32_t* dst, size_t n, uint32_t pixel)
+{
+    // Write single pixels until dst is 16-byte aligned
+    size_t i = 0;
+    for (; i < n && (reinterpret_cast<uintptr_t>(dst + i) & 15); i++)
+        dst[i] = pixel;
+    __m128i v = _mm_set1_epi32(int(pixel));
+    for (; i + 8 <= n; i += 8) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(dst + i), v);
+        _mm_store_si128(reinterpret_cast<__m128i*>(dst + i + 4), v);
+    }
+    for (; i < n; i++)
+        dst[i] = pixel;
+}
+
+RUBIKS_TARGET_AVX2
+void FillSpanAVX2(uint32_t* dst, size_t n, uint32_t pixel)
+{
+    // Write single pixels until dst is 32-byte aligned
+    size_t i = 0;
+    for (; i < n && (reinterpret_cast<uintptr_t>(dst + i) & 31); i++)
+        dst[i] = pixel;
+    __m256i v = _mm256_set1_epi32(int(pixel));
+    for (; i + 16 <= n; i += 16) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(dst + i), v);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(dst + i + 8), v);
+    }
+    if (i + 8 <= n) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(dst + i), v);
+        i += 8;
+    }
+    for (; i < n; i++)
+        dst[i] = pixel;
+}
+
+bool CpuHasAVX2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)  // the OS saves YMM registers
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+bool CpuHasSSE2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;
+#elif defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2") != 0;
+#endif
+}
+
+#endif  // RUBIKS_SPAN_X86
+
+#ifdef RUBIKS_SPAN_NEON
+
+void FillSpanNEON(uint32_t* dst, size_t n, uint32_t pixel)
+{
+    size_t i = 0;
+    uint32x4_t v = vdupq_n_u32(pixel);
+    for (; i + 8 <= n; i += 8) {
+        vst1q_u32(dst + i, v);
+        vst1q_u32(dst + i + 4, v);
+    }
+    for (; i < n; i++)
+        dst[i] = pixel;
+}
+
+#endif  // RUBIKS_SPAN_NEON
+
+SpanKernel DetectSpanKernel()
+{
+#if defined(RUBIKS_SPAN_X86)
+    if (CpuHasAVX2())
+        return SPAN_KERNEL_AVX2;
+    if (CpuHasSSE2())
+        return SPAN_KERNEL_SSE2;
+#elif defined(RUBIKS_SPAN_NEON)
+    return SPAN_KERNEL_NEON;
+#endif
+    return SPAN_KERNEL_SCALAR;
+}
+
+}  // namespace
+
+FillSpanFunc GetFillSpan(SpanKernel kernel)
+{
+    switch (kernel) {
+    case SPAN_KERNEL_SCALAR:
+        return FillSpanScalar;
+#if defined(RUBIKS_SPAN_X86)
+    case SPAN_KERNEL_SSE2:
+        return CpuHasSSE2() ? FillSpanSSE2 : nullptr;
+    case SPAN_KERNEL_AVX2:
+        return CpuHasAVX2() ? FillSpanAVX2 : nullptr;
+#elif defined(RUBIKS_SPAN_NEON)
+    case SPAN_KERNEL_NEON:
+        return FillSpanNEON;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+SpanKernel BestSpanKernel()
+{
+    static const SpanKernel kernel = DetectSpanKernel();
+    return kernel;
+}
+
+const char* SpanKernelName(SpanKernel kernel)
+{
+    static const char* NAMES[SPAN_KERNEL_MAX] = { "scalar", "sse2", "avx2", "neon" };
+    if (kernel < 0 || kernel >= SPAN_KERNEL_MAX)
+        return "unknown";
+    return NAMES[kernel];
+}
+
+void FillSpan(uint32_t* dst, size_t n, uint32_t pixel)
+{
+    static const FillSpanFunc func = GetFillSpan(BestSpanKernel());
+    func(dst, n, pixel);
+}
+
+}  // namespace simd
@@ -0,0 +1,96 @@
+#include "symmetry.hpp"
+
+namespace rubiks {
+
+namespace {
+
+struct BasicSymmetry {
+    int corner_perm[8];
+    int corner_ori[8];
+    int edge_perm[12];
+    int edge_ori[12];
+};
+
+// Cubies of the 4 basic symmetries, in the same corner and edge order as CubieCube
+const BasicSymmetry ROT_URF3 = {
+    { URF, DFR, DLF, UFL, UBR, DRB, DBL, ULB }, { 1, 2, 1, 2, 2, 1, 2, 1 },
+    { UF, FR, DF, FL, UB, BR, DB, BL, UR, DR, DL, UL }, { 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 1 }
+};
+const BasicSymmetry ROT_F2 = {
+    { DLF, DFR, DRB, DBL, UFL, URF, UBR, ULB }, { 0, 0, 0, 0, 0, 0, 0, 0 },
+    { DL, DF, DR, DB, UL, UF, UR, UB, FL, FR, BR, BL }, { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }
+};
+const BasicSymmetry ROT_U4 = {
+    { UBR, URF, UFL, ULB, DRB, DFR, DLF, DBL }, { 0, 0, 0, 0, 0, 0, 0, 0 },
+    { UB, UR, UF, UL, DB, DR, DF, DL, BR, FR, FL, BL }, { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1 }
+};
+const BasicSymmetry MIRR_LR2 = {
+    { UFL, URF, UBR, ULB, DLF, DFR, DRB, DBL }, { 3, 3, 3, 3, 3, 3, 3, 3 },
+    { UL, UF, UR, UB, DL, DF, DR, DB, FL, FR, BR, BL }, { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }
+};
+
+CubieCube MakeCube(const BasicSymmetry& sym)
+{
+    CubieCube c;
+    for (int i = 0; i < 8; i++)
+        c.SetCorner(i, sym.corner_perm[i], sym.corner_ori[i]);
+    for (int i = 0; i < 12; i++)
+        c.SetEdge(i, sym.edge_perm[i], sym.edge_ori[i]);
+    return c;
+}
+
+void MultiplyBy(CubieCube* a, const CubieCube& b)
+{
+    CubieCube result;
+    MultiplySymmetric(*a, b, &result);
+    *a = result;
+}
+
+}  // namespace
+
+void Symmetries::Build(const CubieCube* face_turns)
+{
+    CubieCube urf3 = MakeCube(ROT_URF3);
+    CubieCube f2 = MakeCube(ROT_F2);
+    CubieCube u4 = MakeCube(ROT_U4);
+    CubieCube lr2 = MakeCube(MIRR_LR2);
+
+    CubieCube c;
+    int s = 0;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 2; j++) {
+            for (int k = 0; k < 4; k++) {
+                for (int l = 0; l < 2; l++) {
+                    cubes[s++] = c;
+                    MultiplyBy(&c, lr2);
+                }
+                MultiplyBy(&c, u4);
+            }
+            MultiplyBy(&c, f2);
+        }
+        MultiplyBy(&c, urf3);
+    }
+
+    CubieCube solved;
+    for (int a = 0; a < SYM_NUM; a++) {
+        for (int b = 0; b < SYM_NUM; b++) {
+            CubieCube product;
+            MultiplySymmetric(cubes[a], cubes[b], &product);
+            if (product == solved)
+                inverse[a] = b;
+        }
+    }
+
+    for (int a = 0; a < SYM_NUM; a++) {
+        for (int m = 0; m < FACE_TURN_NUM; m++) {
+            CubieCube conjugated;
+            Conjugate(face_turns[m], a, &conjugated);
+            for (int n = 0; n < FACE_TURN_NUM; n++) {
+                if (conjugated == face_turns[n])
+                    moves[a][m] = n;
+            }
+        }
+    }
+}
+
+}  // namespace rubiks
@@ -0,0 +1,309 @@
+#include "table_cache.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#include <random>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rubiks {
+
+namespace {
+
+const char TABLE_FILE_MAGIC[8] = { 'R', 'B', 'K', 'T', 'A', 'B', 'L', 'E' };
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const uint64_t TABLE_ALIGNMENT = 64;
+
+uint64_t HeaderChecksum(const TableFileHeader& header)
+{
+    return Fnv1a(&header, offsetof(TableFileHeader, header_checksum));
+}
+
+void MakeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+// Create a file next to path with a name no other process uses.
+// Processes generating the same tables at once then never write into one file.
+FILE* CreateTempFile(const std::string& path, std::string* temp_path)
+{
+#ifdef _WIN32
+    std::random_device random;
+    for (int attempt = 0; attempt < 16; attempt++) {
+        char suffix[48];
+        snprintf(suffix, sizeof(suffix), ".%lu.%08x.tmp",
+                 (unsigned long)GetCurrentProcessId(), unsigned(random()));
+        *temp_path = path + suffix;
+        int fd = _open(temp_path->c_str(), _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY,
+                       _S_IREAD | _S_IWRITE);
+        if (fd >= 0)
+            return _fdopen(fd, "wb");
+    }
+    return nullptr;
+#else
+    std::string name = path + ".XXXXXX";
+    int fd = mkstemp(&name[0]);
+    if (fd < 0)
+        return nullptr;
+    *temp_path = name;
+    fchmod(fd, 0644);  // mkstemp makes files only the owner can read
+    FILE* fp = fdopen(fd, "wb");
+    if (!fp) {
+        close(fd);
+        remove(name.c_str());
+    }
+    return fp;
+#endif
+}
+
+}  // namespace
+
+MappedFile::MappedFile() : m_data(nullptr), m_size(0)
+#ifdef _WIN32
+    , m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+#endif
+{}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const std::string& path)
+{
+    Close();
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                         nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+        Close();
+        return false;
+    }
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping == nullptr) {
+        Close();
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data == nullptr) {
+        Close();
+        return false;
+    }
+    m_size = size_t(size.QuadPart);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+    m_data = nullptr;
+    m_size = 0;
+    m_mapping = nullptr;
+    m_file = INVALID_HANDLE_VALUE;
+}
+#else
+bool MappedFile::Open(const std::string& path)
+{
+    Close();
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    // The mapping stays valid after closing the file.
+    void* data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    m_data = static_cast<const uint8_t*>(data);
+    m_size = size_t(st.st_size);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_data)
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+#endif
+
+bool SaveTables(const std::string& path, const TableFileInfo& info,
+                PruningTable* const* tables)
+{
+    int table_num = int(info.table_sizes.size());
+    if (table_num > MAX_TABLE_FILE_TABLES)
+        return false;
+
+    TableFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TABLE_FILE_MAGIC, sizeof(header.magic));
+    header.format_version = TABLE_FILE_FORMAT_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    strncpy(header.name, info.name, sizeof(header.name) - 1);
+    header.version = info.version;
+    header.cube_num = info.cube_num;
+    header.metric = info.metric;
+    header.table_num = uint32_t(table_num);
+    header.move_hash = info.move_hash;
+    header.checksum = FNV_OFFSET_BASIS;
+    uint64_t offset = sizeof(TableFileHeader);
+    for (int i = 0; i < table_num; i++) {
+        offset = (offset + TABLE_ALIGNMENT - 1) / TABLE_ALIGNMENT * TABLE_ALIGNMENT;
+        header.table_sizes[i] = tables[i]->Size();
+        header.table_offsets[i] = offset;
+        offset += tables[i]->ByteSize();
+        header.checksum = Fnv1a(tables[i]->Data(), tables[i]->ByteSize(), header.checksum);
+    }
+    header.header_checksum = HeaderChecksum(header);
+
+    std::string temp_path;
+    FILE* fp = CreateTempFile(path, &temp_path);
+    if (!fp)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    uint64_t pos = sizeof(header);
+    static const uint8_t zeros[TABLE_ALIGNMENT] = {};
+    for (int i = 0; i < table_num && ok; i++) {
+        ok = fwrite(zeros, 1, size_t(header.table_offsets[i] - pos), fp) == header.table_offsets[i] - pos;
+        ok = ok && fwrite(tables[i]->Data(), 1, tables[i]->ByteSize(), fp) == tables[i]->ByteSize();
+        pos = header.table_offsets[i] + tables[i]->ByteSize();
+    }
+    ok = fclose(fp) == 0 && ok;
+
+    // Read the file back before other processes can see it.
+    // Loading only checks the header, so the payload is checked here once.
+    if (ok) {
+        MappedFile written;
+        ok = written.Open(temp_path) && VerifyTables(written);
+    }
+
+#ifdef _WIN32
+    // rename() doesn't overwrite files on Windows
+    ok = ok && MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+    if (!ok)
+        remove(temp_path.c_str());
+    return ok;
+}
+
+bool LoadTables(const std::string& path, const TableFileInfo& info,
+                MappedFile* file, PruningTable* const* tables)
+{
+    if (path.empty() || !file->Open(path))
+        return false;
+
+    bool ok = file->Size() >= sizeof(TableFileHeader);
+    TableFileHeader header;
+    if (ok) {
+        memcpy(&header, file->Data(), sizeof(header));
+        ok = memcmp(header.magic, TABLE_FILE_MAGIC, sizeof(header.magic)) == 0 &&
+             header.format_version == TABLE_FILE_FORMAT_VERSION &&
+             header.byte_order == BYTE_ORDER_MARK &&
+             header.header_checksum == HeaderChecksum(header) &&
+             strncmp(header.name, info.name, sizeof(header.name)) == 0 &&
+             header.version == info.version &&
+             header.cube_num == info.cube_num &&
+             header.metric == info.metric &&
+             header.move_hash == info.move_hash &&
+             header.table_num == info.table_sizes.size() &&
+             header.table_num <= uint32_t(MAX_TABLE_FILE_TABLES);
+    }
+    for (uint32_t i = 0; ok && i < header.table_num; i++) {
+        ok = header.table_sizes[i] == info.table_sizes[i] &&
+             header.table_offsets[i] % TABLE_ALIGNMENT == 0 &&
+             header.table_offsets[i] + (header.table_sizes[i] + 1) / 2 <= file->Size();
+    }
+    if (!ok) {
+        file->Close();
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header.table_num; i++)
+        tables[i]->Attach(file->Data() + header.table_offsets[i], header.table_sizes[i]);
+    return true;
+}
+
+bool VerifyTables(const MappedFile& file)
+{
+    if (!file.IsOpen() || file.Size() < sizeof(TableFileHeader))
+        return false;
+    TableFileHeader header;
+    memcpy(&header, file.Data(), sizeof(header));
+    if (header.table_num > uint32_t(MAX_TABLE_FILE_TABLES))
+        return false;
+    uint64_t checksum = FNV_OFFSET_BASIS;
+    for (uint32_t i = 0; i < header.table_num; i++) {
+        uint64_t bytes = (header.table_sizes[i] + 1) / 2;
+        if (header.table_offsets[i] + bytes > file.Size())
+            return false;
+        checksum = Fnv1a(file.Data() + header.table_offsets[i], size_t(bytes), checksum);
+    }
+    return checksum == header.checksum;
+}
+
+std::string TableCachePath(const char* file_name)
+{
+    std::string dir;
+    const char* env = getenv("RUBIKS_TABLE_DIR");
+    if (env && env[0]) {
+        dir = env;
+    } else {
+#ifdef _WIN32
+        const char* base = getenv("LOCALAPPDATA");
+        if (!base || !base[0])
+            return "";
+        dir = std::string(base) + "\\libui-rubiks-demo";
+#else
+        const char* base = getenv("XDG_CACHE_HOME");
+        if (base && base[0]) {
+            dir = base;
+        } else {
+            const char* home = getenv("HOME");
+            if (!home || !home[0])
+                return "";
+            dir = std::string(home) + "/.cache";
+            MakeDirectory(dir);
+        }
+        dir += "/libui-rubiks-demo";
+#endif
+    }
+    MakeDirectory(dir);
+#ifdef _WIN32
+    return dir + "\\" + file_name;
+#else
+    return dir + "/" + file_name;
+#endif
+}
+
+}  // namespace rubiks
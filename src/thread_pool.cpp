@@ -0,0 +1,111 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+namespace rubiks {
+
+ThreadPool::ThreadPool(int thread_num)
+    : m_func(nullptr), m_generation(0), m_active(0), m_quit(false)
+{
+    if (thread_num <= 0)
+        thread_num = std::max(1, int(std::thread::hardware_concurrency()));
+    for (int i = 0; i < thread_num; i++)
+        m_queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    for (int i = 1; i < thread_num; i++)
+        m_threads.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_start.notify_all();
+    for (std::thread& t : m_threads)
+        t.join();
+}
+
+bool ThreadPool::PopTask(int worker, size_t* task)
+{
+    // Take the next task of its own
+    Queue& own = *m_queues[worker];
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.begin < own.end) {
+            *task = own.begin++;
+            return true;
+        }
+    }
+
+    // Steal the last task of another worker
+    int thread_num = ThreadNum();
+    for (int i = 1; i < thread_num; i++) {
+        Queue& other = *m_queues[(worker + i) % thread_num];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (other.begin < other.end) {
+            *task = --other.end;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::RunTasks(int worker)
+{
+    // No tasks are added while running, so empty queues mean that all tasks are taken.
+    size_t task;
+    while (PopTask(worker, &task))
+        (*m_func)(task, worker);
+}
+
+void ThreadPool::WorkerLoop(int worker)
+{
+    uint64_t generation = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start.wait(lock, [&]() { return m_quit || m_generation != generation; });
+            if (m_quit)
+                return;
+            generation = m_generation;
+        }
+        RunTasks(worker);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_active--;
+        }
+        m_finish.notify_one();
+    }
+}
+
+void ThreadPool::ParallelFor(size_t task_num, const TaskFunc& func)
+{
+    int thread_num = ThreadNum();
+    if (thread_num == 1 || task_num <= 1) {
+        for (size_t i = 0; i < task_num; i++)
+            func(i, 0);
+        return;
+    }
+
+    size_t block = (task_num + thread_num - 1) / thread_num;
+    for (int w = 0; w < thread_num; w++) {
+        std::lock_guard<std::mutex> lock(m_queues[w]->mutex);
+        m_queues[w]->begin = std::min(w * block, task_num);
+        m_queues[w]->end = std::min((w + 1) * block, task_num);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_func = &func;
+        m_active = thread_num - 1;
+        m_generation++;
+    }
+    m_start.notify_all();
+    RunTasks(0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_finish.wait(lock, [&]() { return m_active == 0; });
+    m_func = nullptr;
+}
+
+}  // namespace rubiks
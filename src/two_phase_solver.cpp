@@ -0,0 +1,294 @@
+#include "two_phase_solver.hpp"
+#include <algorithm>
+#include <chrono>
+#include "coordinates.hpp"
+
+namespace rubiks {
+
+namespace {
+
+// Increase it when the layout of the tables changes.
+const uint32_t TWO_PHASE_TABLE_VERSION = 1;
+
+// Maximum length of phase 2 solutions
+const int PHASE2_MAX_LENGTH = 18;
+
+double Now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Look at a cube from another orientation.
+CubieCube RotateCube(const TwoPhaseTables& t, const CubieCube& cube, int k)
+{
+    uint8_t facelets[54];
+    cube.ToFacelets(facelets);
+    int colors[6];  // where the center of each face has moved
+    for (int f = 0; f < 6; f++)
+        colors[t.rotation_facelets[k][f * 9 + 4] / 9] = f;
+    uint8_t rotated[54];
+    for (int i = 0; i < 54; i++)
+        rotated[i] = uint8_t(colors[facelets[t.rotation_facelets[k][i]]]);
+    CubieCube c;
+    c.FromFacelets(rotated);
+    return c;
+}
+
+bool IsPhase2Move(int move)
+{
+    int face = move / 3;
+    return face == FACE_U || face == FACE_D || move % 3 == 1;
+}
+
+}  // namespace
+
+// std::min takes it by reference, so it needs a definition in debug builds
+const int TwoPhaseSolver::MAX_PATH_LENGTH;
+
+void TwoPhaseTables::Build(const std::string& cache_path)
+{
+    if (built)
+        return;
+
+    BuildFaceTurnCubes(moves);
+    int all_moves[FACE_TURN_NUM];
+    for (int m = 0; m < FACE_TURN_NUM; m++)
+        all_moves[m] = m;
+
+    coord::BuildMoveTable(moves, all_moves, FACE_TURN_NUM, coord::CORNER_ORI_NUM,
+                          coord::GetCornerOri, coord::SetCornerOri, &twist_move);
+    coord::BuildMoveTable(moves, all_moves, FACE_TURN_NUM, coord::EDGE_ORI_NUM,
+                          coord::GetEdgeOri, coord::SetEdgeOri, &flip_move);
+    coord::BuildMoveTable(moves, all_moves, FACE_TURN_NUM, coord::SLICE_NUM,
+                          coord::GetSlice, coord::SetSlice, &slice_move);
+    coord::BuildMoveTable(moves, PHASE2_MOVES, PHASE2_MOVE_NUM, coord::CORNER_PERM_NUM,
+                          coord::GetCornerPerm, coord::SetCornerPerm, &corner_perm_move);
+    coord::BuildMoveTable(moves, PHASE2_MOVES, PHASE2_MOVE_NUM, coord::UD_EDGE_PERM_NUM,
+                          coord::GetUDEdgePerm, coord::SetUDEdgePerm, &ud_edge_perm_move);
+    coord::BuildMoveTable(moves, PHASE2_MOVES, PHASE2_MOVE_NUM, coord::SLICE_PERM_NUM,
+                          coord::GetSlicePerm, coord::SetSlicePerm, &slice_perm_move);
+
+    TableFileInfo info;
+    info.name = "two_phase";
+    info.version = TWO_PHASE_TABLE_VERSION;
+    info.cube_num = 3;
+    info.metric = METRIC_FACE_TURN;
+    info.move_hash = Fnv1a(moves, sizeof(moves));
+    info.table_sizes.push_back(uint64_t(coord::CORNER_ORI_NUM) * coord::SLICE_NUM);
+    info.table_sizes.push_back(uint64_t(coord::EDGE_ORI_NUM) * coord::SLICE_NUM);
+    info.table_sizes.push_back(uint64_t(coord::CORNER_ORI_NUM) * coord::EDGE_ORI_NUM);
+    info.table_sizes.push_back(uint64_t(coord::CORNER_PERM_NUM) * coord::SLICE_PERM_NUM);
+    info.table_sizes.push_back(uint64_t(coord::UD_EDGE_PERM_NUM) * coord::SLICE_PERM_NUM);
+    PruningTable* tables[] = {
+        &twist_slice_table, &flip_slice_table, &twist_flip_table,
+        &corner_slice_table, &edge_slice_table
+    };
+    if (!LoadTables(cache_path, info, &table_file, tables)) {
+        // All coordinates are 0 for the solved state.
+        CoordPairSpace twist_slice(twist_move.data(), coord::CORNER_ORI_NUM,
+                                   slice_move.data(), coord::SLICE_NUM, FACE_TURN_NUM);
+        twist_slice_table.Generate(twist_slice, 0);
+        CoordPairSpace flip_slice(flip_move.data(), coord::EDGE_ORI_NUM,
+                                  slice_move.data(), coord::SLICE_NUM, FACE_TURN_NUM);
+        flip_slice_table.Generate(flip_slice, 0);
+        CoordPairSpace twist_flip(twist_move.data(), coord::CORNER_ORI_NUM,
+                                  flip_move.data(), coord::EDGE_ORI_NUM, FACE_TURN_NUM);
+        twist_flip_table.Generate(twist_flip, 0);
+        CoordPairSpace corner_slice(slice_perm_move.data(), coord::SLICE_PERM_NUM,
+                                    corner_perm_move.data(), coord::CORNER_PERM_NUM, PHASE2_MOVE_NUM);
+        corner_slice_table.Generate(corner_slice, 0);
+        CoordPairSpace edge_slice(slice_perm_move.data(), coord::SLICE_PERM_NUM,
+                                  ud_edge_perm_move.data(), coord::UD_EDGE_PERM_NUM, PHASE2_MOVE_NUM);
+        edge_slice_table.Generate(edge_slice, 0);
+
+        // Map the saved file to share its pages with other processes
+        if (!cache_path.empty() && SaveTables(cache_path, info, tables))
+            LoadTables(cache_path, info, &table_file, tables);
+    }
+
+    // Rotate the whole cube by x and y. Applying it 3 times brings the cube back.
+    FaceletMoveTable table;
+    table.Build(3);
+    std::vector<uint8_t> work(table.max_move_size);
+    uint8_t facelets[54];
+    for (int i = 0; i < 54; i++)
+        facelets[i] = uint8_t(i);
+    for (int k = 0; k < 3; k++) {
+        std::copy(facelets, facelets + 54, rotation_facelets[k]);
+        for (int f = 0; f < 6; f++) {
+            int from = facelets[NOTATION_FACES[f] * 9 + 4] / 9;
+            rotation_faces[k][f] = int(std::find(NOTATION_FACES, NOTATION_FACES + 6, from) - NOTATION_FACES);
+        }
+        for (int layer = 0; layer < 3; layer++)
+            table.Apply(table.MoveIndex(AXIS_X, layer, DEGREE_90), facelets, work.data());
+        for (int layer = 0; layer < 3; layer++)
+            table.Apply(table.MoveIndex(AXIS_Y, layer, DEGREE_90), facelets, work.data());
+    }
+
+    built = true;
+}
+
+int TwoPhaseSolver::Phase1Heuristic(int twist, int flip, int slice, int limit) const
+{
+    const TwoPhaseTables& t = *m_tables;
+    int h = t.twist_slice_table.Get(uint32_t(slice) * coord::CORNER_ORI_NUM + twist);
+    if (h > limit)
+        return h;
+    h = std::max(h, t.flip_slice_table.Get(uint32_t(slice) * coord::EDGE_ORI_NUM + flip));
+    if (h > limit)
+        return h;
+    return std::max(h, t.twist_flip_table.Get(uint32_t(flip) * coord::CORNER_ORI_NUM + twist));
+}
+
+bool TwoPhaseSolver::Phase1(int twist, int flip, int slice, int depth, int bound, int last_face)
+{
+    const TwoPhaseTables& t = *m_tables;
+    for (int face = 0; face < 6; face++) {
+        if (face == last_face || face + 3 == last_face)
+            continue;
+        for (int turns = 1; turns <= 3; turns++) {
+            int move = FaceTurn(face, turns);
+            int new_twist = t.twist_move[twist * FACE_TURN_NUM + move];
+            int new_flip = t.flip_move[flip * FACE_TURN_NUM + move];
+            int new_slice = t.slice_move[slice * FACE_TURN_NUM + move];
+            m_node_count++;
+            int h = Phase1Heuristic(new_twist, new_flip, new_slice, bound - depth - 1);
+            if (depth + 1 + h > bound)
+                continue;
+            m_path[depth] = move;
+            if (depth + 1 == bound) {
+                // Reached the subgroup (h == 0).
+                // A phase 2 move at the end means a shorter phase 1 solution was already tried.
+                if (!IsPhase2Move(move))
+                    StartPhase2(bound);
+            } else {
+                Phase1(new_twist, new_flip, new_slice, depth + 1, bound, face);
+            }
+            if (m_done)
+                return true;
+        }
+    }
+    return false;
+}
+
+void TwoPhaseSolver::StartPhase2(int phase1_length)
+{
+    if (Now() > m_deadline) {
+        m_done = true;
+        return;
+    }
+
+    int limit = std::min(m_max_length - phase1_length, PHASE2_MAX_LENGTH);
+    if (limit < 0)
+        return;
+
+    CubieCube c = m_cubes[m_variant];
+    for (int i = 0; i < phase1_length; i++)
+        c.Multiply(m_tables->moves[m_path[i]]);
+    int corner_perm = coord::GetCornerPerm(c);
+    int ud_edge_perm = coord::GetUDEdgePerm(c);
+    int slice_perm = coord::GetSlicePerm(c);
+    int h = std::max(
+        m_tables->corner_slice_table.Get(uint32_t(corner_perm) * coord::SLICE_PERM_NUM + slice_perm),
+        m_tables->edge_slice_table.Get(uint32_t(ud_edge_perm) * coord::SLICE_PERM_NUM + slice_perm));
+
+    m_phase1_length = phase1_length;
+    int last_face = phase1_length > 0 ? m_path[phase1_length - 1] / 3 : -1;
+    for (int bound = h; bound <= limit; bound++) {
+        bool found = bound == 0 ||
+            Phase2(corner_perm, ud_edge_perm, slice_perm, 0, bound, last_face);
+        if (found) {
+            SetSolution(phase1_length + bound);
+            return;
+        }
+    }
+}
+
+void TwoPhaseSolver::SetSolution(int length)
+{
+    // Convert the path back to moves of the original cube
+    int k = m_variant % 3;
+    bool inverse = m_variant >= 3;
+    m_solution.resize(length);
+    for (int i = 0; i < length; i++) {
+        int move = m_path[inverse ? length - 1 - i : i];
+        int face = m_tables->rotation_faces[k][move / 3];
+        int turns = move % 3 + 1;
+        m_solution[i] = FaceTurn(face, inverse ? 4 - turns : turns);
+    }
+    m_found = true;
+    m_done = true;
+}
+
+bool TwoPhaseSolver::Phase2(int corner_perm, int ud_edge_perm, int slice_perm,
+                            int depth, int bound, int last_face)
+{
+    const TwoPhaseTables& t = *m_tables;
+    for (int i = 0; i < PHASE2_MOVE_NUM; i++) {
+        int move = PHASE2_MOVES[i];
+        int face = move / 3;
+        if (face == last_face || face + 3 == last_face)
+            continue;
+        int new_cp = t.corner_perm_move[corner_perm * PHASE2_MOVE_NUM + i];
+        int new_ep = t.ud_edge_perm_move[ud_edge_perm * PHASE2_MOVE_NUM + i];
+        int new_sp = t.slice_perm_move[slice_perm * PHASE2_MOVE_NUM + i];
+        m_node_count++;
+        int h = std::max(
+            t.corner_slice_table.Get(uint32_t(new_cp) * coord::SLICE_PERM_NUM + new_sp),
+            t.edge_slice_table.Get(uint32_t(new_ep) * coord::SLICE_PERM_NUM + new_sp));
+        if (depth + 1 + h > bound)
+            continue;
+        m_path[m_phase1_length + depth] = move;
+        if (h == 0 || Phase2(new_cp, new_ep, new_sp, depth + 1, bound, face))
+            return true;
+    }
+    return false;
+}
+
+bool TwoPhaseSolver::Solve(const CubieCube& cube, std::vector<int>* solution,
+                           int max_length, double timeout)
+{
+    m_node_count = 0;
+    solution->clear();
+    if (!cube.IsValid() || !m_tables->built)
+        return false;
+
+    m_max_length = std::min(max_length, MAX_PATH_LENGTH);
+    m_deadline = Now() + timeout;
+    m_found = false;
+    m_done = false;
+
+    int twist[VARIANT_NUM];
+    int flip[VARIANT_NUM];
+    int slice[VARIANT_NUM];
+    int h[VARIANT_NUM];
+    CubieCube inverse = cube.Inverse();
+    for (int v = 0; v < VARIANT_NUM; v++) {
+        m_cubes[v] = RotateCube(*m_tables, v < 3 ? cube : inverse, v % 3);
+        twist[v] = coord::GetCornerOri(m_cubes[v]);
+        flip[v] = coord::GetEdgeOri(m_cubes[v]);
+        slice[v] = coord::GetSlice(m_cubes[v]);
+        h[v] = Phase1Heuristic(twist[v], flip[v], slice[v], MAX_PATH_LENGTH);
+    }
+
+    // Deepen phase 1 of all variants together
+    for (int bound = 0; bound <= m_max_length && !m_done; bound++) {
+        for (m_variant = 0; m_variant < VARIANT_NUM && !m_done; m_variant++) {
+            int v = m_variant;
+            if (h[v] > bound)
+                continue;
+            if (bound == 0)
+                StartPhase2(0);
+            else
+                Phase1(twist[v], flip[v], slice[v], 0, bound, -1);
+        }
+    }
+
+    if (!m_found)
+        return false;
+    *solution = m_solution;
+    return true;
+}
+
+}  // namespace rubiks